@@ -2,8 +2,9 @@
 
 #include "config.h"
 #include <utility>
-#include <stack>
 #include <random>
+#include <cstdint>
+#include <vector>
 
 using namespace std;
 
@@ -13,6 +14,9 @@ struct Point
   int x, y;
 };
 
+// Состояние поля доски. Все биты состояния помещаются в один байт.
+typedef uint8_t PointState;
+
 // Используемый шаблон в начале игры.
 // BEGIN_PATTERN_CLEAN - начало с чистого поля.
 // BEGIN_PATTERN_CROSSWIRE - начало со скреста.
@@ -24,6 +28,26 @@ enum BeginPattern
   BEGIN_PATTERN_SQUARE
 };
 
+// Правило обработки пустых баз.
+// SUR_COND_STANDART - если игрок ставит в пустую базу и ничего не обводит, то база противника обводит эту территорию.
+// SUR_COND_ALWAYS - обводить базу, даже если нет вражеских точек внутри.
+// SUR_COND_ALWAYS_ENEMY - при ходе в пустую базу всегда обводит её хозяин.
+enum SurroundCondition
+{
+  SUR_COND_STANDART,
+  SUR_COND_ALWAYS,
+  SUR_COND_ALWAYS_ENEMY
+};
+
+// Способ копирования поля.
+// FIELD_COPY_FULL - копируется вся история, ходы можно откатывать до начала игры.
+// FIELD_COPY_SNAPSHOT - копируется только текущая позиция, откатывать можно лишь ходы, сделанные после копирования.
+enum FieldCopy
+{
+  FIELD_COPY_FULL,
+  FIELD_COPY_SNAPSHOT
+};
+
 enum IntersectionState
 {
   INTERSECTION_STATE_NONE,
@@ -41,13 +65,62 @@ struct BoardChange
   int player;
   // Предыдущий хеш.
   int64_t hash;
-  // Список изменных точек (координата - значение до изменения).
-  stack<pair<int, int>> changes;
-  BoardChange(int redCaptureCount, int blackCaptureCount, int lastPlayer, int64_t lastHash)
+#if ZOBRIST_LOCK
+  // Предыдущий замок хеша.
+  int64_t lock;
+#endif
+  // Начало изменений этого хода в общем журнале изменений точек.
+  int journalBegin;
+  // Начало объединений групп этого хода в журнале объединений.
+  int groupJournalBegin;
+  // Начало плиток, ставших активными на этом ходу, в журнале активных плиток (см. Field::_activeTiles).
+  int activeJournalBegin;
+  BoardChange(int redCaptureCount, int blackCaptureCount, int lastPlayer, int64_t lastHash, int lastJournalSize, int lastGroupJournalSize)
   {
     captureCount[0] = redCaptureCount;
     captureCount[1] = blackCaptureCount;
     player = lastPlayer;
     hash = lastHash;
+    journalBegin = lastJournalSize;
+    groupJournalBegin = lastGroupJournalSize;
   }
 };
+
+// Координаты всех позиций доски с расстоянием stride между соседними по вертикали позициями.
+// Зависят только от размера доски и не меняются, поэтому одна таблица разделяется всеми копиями поля.
+struct FieldCoordinates
+{
+  vector<int16_t> x, y;
+
+  FieldCoordinates(const int stride, const int length) : x(length), y(length)
+  {
+    for (int pos = 0; pos < length; pos++)
+    {
+      x[pos] = static_cast<int16_t>(pos % stride - 1);
+      y[pos] = static_cast<int16_t>(pos / stride - 1);
+    }
+  }
+};
+
+// Сохраненная позиция поля, к которой можно вернуться сразу через несколько ходов (см. Field::makeCheckpoint).
+struct FieldCheckpoint
+{
+  // Состояния точек активных плиток поля подряд, в порядке возрастания координаты (вне них состояния исходные).
+  vector<PointState> points;
+  // Количество ходов и размеры журналов.
+  int movesCount;
+  int journalSize;
+  int groupJournalSize;
+  // Размер журнала активных плиток.
+  int activeJournalSize;
+  int captureCount[2];
+  int player;
+  int64_t hash;
+#if ZOBRIST_LOCK
+  int64_t lock;
+#endif
+  // Хеши симметричных отображений позиции, если они вычислялись.
+  int symmetriesCount;
+  int64_t symmetryHashes[8];
+  int symmetryHashesHistorySize;
+};
@@ -0,0 +1,521 @@
+#include "config.h"
+#include "basic_types.h"
+#include "field.h"
+#include "zobrist.h"
+#include "trajectories.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+// Micro-benchmarks of Field operations.
+// Usage: opai_bench [--csv] [--repeats N]
+// Results are printed as JSON (or CSV) to standard output, one record for every benchmark and board size.
+
+// Number of allocations and allocated bytes since the start of the program.
+static long allocationsCount = 0;
+static long allocatedBytes = 0;
+
+void* operator new(size_t size)
+{
+  allocationsCount++;
+  allocatedBytes += size;
+  void* result = malloc(size == 0 ? 1 : size);
+  if (result == nullptr)
+    throw bad_alloc();
+  return result;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+struct BenchResult
+{
+  string name;
+  int width;
+  int height;
+  // Operations made by one repetition.
+  long ops;
+  // Best and mean time of one operation over all repetitions.
+  double bestNs;
+  double meanNs;
+  // Allocations made by one operation.
+  double allocs;
+  double bytes;
+  // Checksum of results, equal for equal behaviour of Field.
+  int64_t checksum;
+};
+
+static int repeats = 5;
+static vector<BenchResult> results;
+
+// Runs body repeats times. Body makes some operations, returns their number and adds their results to checksum.
+template<typename Body>
+void measure(const string& name, const int width, const int height, const Body& body)
+{
+  BenchResult result;
+  result.name = name;
+  result.width = width;
+  result.height = height;
+  result.bestNs = 0;
+  result.meanNs = 0;
+  for (int i = 0; i < repeats; i++)
+  {
+    int64_t checksum = 0;
+    long allocations = allocationsCount;
+    long bytes = allocatedBytes;
+    auto begin = chrono::steady_clock::now();
+    long ops = body(checksum);
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count() / max(ops, 1L);
+    if (i == 0 || ns < result.bestNs)
+      result.bestNs = ns;
+    result.meanNs += ns / repeats;
+    result.ops = ops;
+    result.allocs = static_cast<double>(allocationsCount - allocations) / max(ops, 1L);
+    result.bytes = static_cast<double>(allocatedBytes - bytes) / max(ops, 1L);
+    result.checksum = checksum;
+  }
+  results.push_back(result);
+}
+
+// Number of operations for one repetition of a benchmark, which makes work proportional to the field size,
+// so that every repetition takes similar time on all sizes.
+int iterations(const int width, const int height, const int work)
+{
+  return max(10, work / (width * height));
+}
+
+// All positions of the field in random order.
+vector<int> shuffledPositions(Field& field, const int seed)
+{
+  vector<int> positions;
+  for (int y = 0; y < field.getHeight(); y++)
+    for (int x = 0; x < field.getWidth(); x++)
+      positions.push_back(field.toPos(x, y));
+  mt19937 gen(seed);
+  shuffle(positions.begin(), positions.end(), gen);
+  return positions;
+}
+
+// Puts points of both players in turn to count random positions.
+void randomFill(Field& field, const int count, const int seed)
+{
+  vector<int> positions = shuffledPositions(field, seed);
+  int moves = 0;
+  for (auto i = positions.begin(); i != positions.end() && moves < count; i++)
+    if (field.isPuttingAllowed(*i))
+    {
+      field.doUnsafeStep(*i);
+      moves++;
+    }
+}
+
+// Puts points of player on the border of the rectangle from (1, 1) to (width - 2, height - 2) except gap.
+void placeRing(Field& field, const int player, const int gap)
+{
+  for (int x = 1; x < field.getWidth() - 1; x++)
+    for (int y = 1; y < field.getHeight() - 1; y++)
+      if ((x == 1 || y == 1 || x == field.getWidth() - 2 || y == field.getHeight() - 2) && field.toPos(x, y) != gap)
+        field.doUnsafeStep(field.toPos(x, y), player);
+}
+
+void benchRandomFill(const int width, const int height, Zobrist* zobrist)
+{
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  vector<int> positions = shuffledPositions(field, 1);
+  int count = iterations(width, height, 200000);
+  measure("do_undo_random_fill", width, height, [&](int64_t& checksum)
+  {
+    long ops = 0;
+    for (int k = 0; k < count; k++)
+    {
+      int moves = 0;
+      for (auto i = positions.begin(); i != positions.end(); i++)
+        if (field.isPuttingAllowed(*i))
+        {
+          field.doUnsafeStep(*i);
+          checksum = checksum * 31 + field.getHash() + field.getHashLock();
+          moves++;
+        }
+      checksum += field.getScore(playerRed);
+      for (int i = 0; i < moves; i++)
+        field.undoStep();
+      ops += moves;
+    }
+    return ops;
+  });
+}
+
+void benchCheckpoint(const int width, const int height, Zobrist* zobrist)
+{
+  // The same moves as in do_undo_random_fill, but they are rolled back by one restoreCheckpoint.
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  vector<int> positions = shuffledPositions(field, 1);
+  FieldCheckpoint checkpoint;
+  int count = iterations(width, height, 200000);
+  measure("restore_checkpoint", width, height, [&](int64_t& checksum)
+  {
+    long ops = 0;
+    for (int k = 0; k < count; k++)
+    {
+      field.makeCheckpoint(checkpoint);
+      for (auto i = positions.begin(); i != positions.end(); i++)
+        if (field.isPuttingAllowed(*i))
+        {
+          field.doUnsafeStep(*i);
+          checksum = checksum * 31 + field.getHash();
+          ops++;
+        }
+      checksum += field.getScore(playerRed);
+      field.restoreCheckpoint(checkpoint);
+    }
+    return ops;
+  });
+}
+
+void benchCapture(const int width, const int height, Zobrist* zobrist)
+{
+  // Red ring with one gap around black points, closing move captures them all.
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  int gap = field.toPos(1, height / 2);
+  placeRing(field, playerRed, gap);
+  for (int x = 2; x < width - 2; x++)
+    for (int y = 2; y < height - 2; y++)
+      if ((x + y) % 3 == 0)
+        field.doUnsafeStep(field.toPos(x, y), playerBlack);
+  int count = iterations(width, height, 1000000);
+  measure("do_undo_capture", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      field.doUnsafeStep(gap, playerRed);
+      checksum += field.getScore(playerRed);
+      field.undoStep();
+    }
+    return static_cast<long>(count);
+  });
+}
+
+void benchEmptyBase(const int width, const int height, Zobrist* zobrist)
+{
+  // Closed red ring without black points inside is an empty base.
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  placeRing(field, playerRed, -1);
+  int center = field.toPos(width / 2, height / 2);
+  int count = iterations(width, height, 1000000);
+  measure("do_undo_empty_base_enemy", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      field.doUnsafeStep(center, playerBlack);
+      checksum += field.getScore(playerRed);
+      field.undoStep();
+    }
+    return static_cast<long>(count);
+  });
+  // The same base filled with diagonal lines of red points, so that the enclosing ring is far from the move.
+  Field filled(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  for (int x = 2; x < width - 2; x++)
+    for (int y = 2; y < height - 2; y++)
+      if ((x + y) % 3 == 0 && field.toPos(x, y) != center && field.toPos(x, y) != center + 1)
+        filled.doUnsafeStep(filled.toPos(x, y), playerRed);
+  placeRing(filled, playerRed, -1);
+  int filledCenter = (width / 2 + height / 2) % 3 == 0 ? center + 1 : center;
+  measure("do_undo_empty_base_enemy_filled", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      filled.doUnsafeStep(filledCenter, playerBlack);
+      checksum += filled.getScore(playerRed) + (filled.getHash() & 0xFFFF);
+      filled.undoStep();
+    }
+    return static_cast<long>(count);
+  });
+  int ownCount = 200000;
+  measure("do_undo_empty_base_own", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < ownCount; i++)
+    {
+      field.doUnsafeStep(center, playerRed);
+      checksum += field.getHash() & 0xFFFF;
+      field.undoStep();
+    }
+    return static_cast<long>(ownCount);
+  });
+}
+
+void benchWave(const int width, const int height, Zobrist* zobrist)
+{
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  randomFill(field, width * height / 3, 2);
+  vector<int> starts;
+  for (int pos = field.minPos(); pos <= field.maxPos(); pos++)
+    if (field.isPuttingAllowed(pos))
+      starts.push_back(pos);
+  int count = iterations(width, height, 2500000);
+  measure("wave", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+      checksum += field.wave(starts[i % starts.size()], [&](int pos) { return field.isPuttingAllowed(pos); });
+    return static_cast<long>(count);
+  });
+}
+
+void benchBuildChain(const int width, const int height, Zobrist* zobrist)
+{
+  // Chain goes around the whole closed red ring.
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  placeRing(field, playerRed, -1);
+  int startPos = field.toPos(1, height / 2);
+  int directionPos = field.toPos(1, height / 2 + 1);
+  int count = iterations(width, height, 1500000);
+  measure("build_chain", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+      checksum += field.buildPlayerChain(startPos, playerRed, directionPos) ? 1 : 0;
+    return static_cast<long>(count);
+  });
+}
+
+void benchNeighbourhood(const int width, const int height, Zobrist* zobrist)
+{
+  // Neighbourhood queries of every field of a half filled board.
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  randomFill(field, width * height / 2, 5);
+  measure("neighbourhood_queries", width, height, [&](int64_t& checksum)
+  {
+    long ops = 0;
+    for (int k = 0; k < 100; k++)
+      for (int pos = field.minPos(); pos <= field.maxPos(); pos++)
+      {
+        checksum += field.numberNearGroups(pos, playerRed) * 9 + field.numberNearPoints(pos, playerBlack) + field.isNearPoints(pos, playerRed);
+        ops++;
+      }
+    return ops;
+  });
+}
+
+void benchTrajectories(const int width, const int height, Zobrist* zobrist)
+{
+  // Child search node on a densely filled board with many trajectories: copying of parent trajectories,
+  // exclusion of composite and unnecessary ones and collection of moves.
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  randomFill(field, width * height * 7 / 10, 11);
+  TrajectoriesArena arena(field.getLength(), field.getWidth());
+  Trajectories root(&field, &arena);
+  root.buildTrajectories(4);
+  int count = iterations(width, height, 20000);
+  measure("trajectories_node", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      field.setNextPlayer();
+      Trajectories node(&field, &arena);
+      node.buildTrajectories(&root);
+      checksum += node.getPoints()->size;
+      field.setNextPlayer();
+    }
+    return static_cast<long>(count);
+  });
+  // Child node of alphabeta after a move on a trajectory: trajectories of the player to move are built anew.
+  const ArenaSpan<int>* moves = root.getPoints();
+  if (moves->empty())
+    return;
+  int childCount = iterations(width, height, 5000);
+  measure("trajectories_child", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < childCount; i++)
+    {
+      int pos = moves->data[i % moves->size];
+      field.doUnsafeStep(pos);
+      {
+        Trajectories node(&field, &arena);
+        node.buildTrajectories(&root, pos);
+        checksum += node.getPoints()->size;
+      }
+      field.undoStep();
+    }
+    return static_cast<long>(childCount);
+  });
+}
+
+void benchCopy(const int width, const int height, Zobrist* zobrist)
+{
+  Field field(width, height, BEGIN_PATTERN_CLEAN, zobrist);
+  randomFill(field, width * height / 2, 3);
+  int count = iterations(width, height, 5000000);
+  measure("copy_full", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      Field copy(field);
+      checksum += (copy.getHash() & 0xFFFF) + copy.getMovesCount();
+    }
+    return static_cast<long>(count);
+  });
+  measure("copy_snapshot", width, height, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      Field copy(field, FIELD_COPY_SNAPSHOT);
+      checksum += (copy.getHash() & 0xFFFF) + copy.getMovesCount();
+    }
+    return static_cast<long>(count);
+  });
+}
+
+// Benchmarks with the same local activity in the center of boards of growing size.
+// With costs scaling with the number of stones instead of the board area their times stay flat.
+void benchScaling(const int size, Zobrist* zobrist)
+{
+  Field field(size, size, BEGIN_PATTERN_CLEAN, zobrist);
+  int center = size / 2;
+  // Black points inside a red ring 8x8 with one gap, closing move captures them.
+  for (int x = center - 4; x <= center + 3; x++)
+    for (int y = center - 4; y <= center + 3; y++)
+      if (x == center - 4 || y == center - 4 || x == center + 3 || y == center + 3)
+      {
+        if (x != center - 4 || y != center)
+          field.doUnsafeStep(field.toPos(x, y), playerRed);
+      }
+      else if ((x + y) % 3 == 0)
+      {
+        field.doUnsafeStep(field.toPos(x, y), playerBlack);
+      }
+  int gap = field.toPos(center - 4, center);
+  measure("scaling_capture", size, size, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < 20000; i++)
+    {
+      field.doUnsafeStep(gap, playerRed);
+      checksum += field.getScore(playerRed);
+      field.undoStep();
+    }
+    return 20000L;
+  });
+  // Random moves in the window 12x12 to the right of the ring.
+  vector<int> window;
+  for (int x = center + 5; x < center + 17 && x < size; x++)
+    for (int y = center - 6; y < center + 6; y++)
+      window.push_back(field.toPos(x, y));
+  mt19937 gen(4);
+  shuffle(window.begin(), window.end(), gen);
+  measure("scaling_local_fill", size, size, [&](int64_t& checksum)
+  {
+    long ops = 0;
+    for (int k = 0; k < 200; k++)
+    {
+      int moves = 0;
+      for (auto i = window.begin(); i != window.end(); i++)
+        if (field.isPuttingAllowed(*i))
+        {
+          field.doUnsafeStep(*i);
+          checksum = checksum * 31 + field.getHash();
+          moves++;
+        }
+      for (int i = 0; i < moves; i++)
+        field.undoStep();
+      ops += moves;
+    }
+    return ops;
+  });
+  Bitboard candidates(field.getLength(), field.getWidth() + 3);
+  measure("scaling_candidates", size, size, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < 20000; i++)
+    {
+      // Captures invalidate the near masks, so that they are rebuilt.
+      field.doUnsafeStep(gap, playerRed);
+      field.undoStep();
+      field.getCandidates(playerRed, candidates);
+      for (int begin = 0, end = 0; field.nextActiveRun(end, begin, end); )
+        for (int pos : candidates.range(begin, end))
+          checksum += pos;
+    }
+    return 20000L;
+  });
+  // The same with points in opposite corners: only tiles around points are scanned, not the board between them.
+  field.doUnsafeStep(field.toPos(1, 1), playerRed);
+  field.doUnsafeStep(field.toPos(size - 2, size - 2), playerBlack);
+  measure("scaling_sparse_candidates", size, size, [&](int64_t& checksum)
+  {
+    for (int i = 0; i < 20000; i++)
+    {
+      field.doUnsafeStep(gap, playerRed);
+      field.undoStep();
+      field.getCandidates(playerRed, candidates);
+      for (int begin = 0, end = 0; field.nextActiveRun(end, begin, end); )
+        for (int pos : candidates.range(begin, end))
+          checksum += pos;
+    }
+    return 20000L;
+  });
+  field.undoStep();
+  field.undoStep();
+}
+
+void printJson()
+{
+  cout << "{" << endl << "  \"sur_cond\": " << SUR_COND << "," << endl << "  \"zobrist_lock\": " << ZOBRIST_LOCK << "," << endl;
+  cout << "  \"board_change_bytes\": " << sizeof(BoardChange) << "," << endl << "  \"repeats\": " << repeats << "," << endl << "  \"benchmarks\": [" << endl;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchResult& r = results[i];
+    cout << "    {\"name\": \"" << r.name << "\", \"width\": " << r.width << ", \"height\": " << r.height << ", \"ops\": " << r.ops;
+    cout << ", \"best_ns\": " << r.bestNs << ", \"mean_ns\": " << r.meanNs << ", \"allocs\": " << r.allocs << ", \"bytes\": " << r.bytes;
+    cout << ", \"checksum\": " << r.checksum << "}" << (i + 1 < results.size() ? "," : "") << endl;
+  }
+  cout << "  ]" << endl << "}" << endl;
+}
+
+void printCsv()
+{
+  cout << "name,width,height,ops,best_ns,mean_ns,allocs,bytes,checksum" << endl;
+  for (auto i = results.begin(); i != results.end(); i++)
+    cout << i->name << "," << i->width << "," << i->height << "," << i->ops << "," << i->bestNs << "," << i->meanNs << "," << i->allocs << "," << i->bytes << "," << i->checksum << endl;
+}
+
+int main(int argc, char** argv)
+{
+  bool csv = false;
+  for (int i = 1; i < argc; i++)
+    if (strcmp(argv[i], "--csv") == 0)
+      csv = true;
+    else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+      repeats = max(1, atoi(argv[++i]));
+  const int sizes[][2] = { {10, 10}, {20, 20}, {39, 32}, {64, 64} };
+  for (auto size : sizes)
+  {
+    int width = size[0], height = size[1];
+    mt19937_64 gen(width * 1000 + height);
+    Zobrist zobrist(2 * (width + 2) * (height + 2), &gen);
+    benchRandomFill(width, height, &zobrist);
+    benchCheckpoint(width, height, &zobrist);
+    benchCapture(width, height, &zobrist);
+    benchEmptyBase(width, height, &zobrist);
+    benchWave(width, height, &zobrist);
+    benchBuildChain(width, height, &zobrist);
+    benchNeighbourhood(width, height, &zobrist);
+    benchTrajectories(width, height, &zobrist);
+    benchCopy(width, height, &zobrist);
+  }
+  const int scalingSizes[] = { 32, 64, 128, 256 };
+  for (auto size : scalingSizes)
+  {
+    mt19937_64 gen(size);
+    Zobrist zobrist(2 * (size + 2) * (size + 2), &gen);
+    benchScaling(size, &zobrist);
+  }
+  if (csv)
+    printCsv();
+  else
+    printJson();
+  return 0;
+}
@@ -0,0 +1,505 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__BMI2__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+/* Vector primitives used by bitboard kernels */
+
+#if defined(__AVX2__)
+typedef __m256i BitboardVector;
+const int bitboardVectorWords = 4;
+inline BitboardVector bitboardLoad(const uint64_t* p)
+{
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline void bitboardStore(uint64_t* p, BitboardVector v)
+{
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+inline BitboardVector bitboardAnd(BitboardVector a, BitboardVector b)
+{
+  return _mm256_and_si256(a, b);
+}
+inline BitboardVector bitboardOr(BitboardVector a, BitboardVector b)
+{
+  return _mm256_or_si256(a, b);
+}
+inline BitboardVector bitboardXor(BitboardVector a, BitboardVector b)
+{
+  return _mm256_xor_si256(a, b);
+}
+// Returns ~a & b.
+inline BitboardVector bitboardAndNot(BitboardVector a, BitboardVector b)
+{
+  return _mm256_andnot_si256(a, b);
+}
+inline BitboardVector bitboardZero()
+{
+  return _mm256_setzero_si256();
+}
+#elif defined(__SSE2__)
+typedef __m128i BitboardVector;
+const int bitboardVectorWords = 2;
+inline BitboardVector bitboardLoad(const uint64_t* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+inline void bitboardStore(uint64_t* p, BitboardVector v)
+{
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+inline BitboardVector bitboardAnd(BitboardVector a, BitboardVector b)
+{
+  return _mm_and_si128(a, b);
+}
+inline BitboardVector bitboardOr(BitboardVector a, BitboardVector b)
+{
+  return _mm_or_si128(a, b);
+}
+inline BitboardVector bitboardXor(BitboardVector a, BitboardVector b)
+{
+  return _mm_xor_si128(a, b);
+}
+inline BitboardVector bitboardAndNot(BitboardVector a, BitboardVector b)
+{
+  return _mm_andnot_si128(a, b);
+}
+inline BitboardVector bitboardZero()
+{
+  return _mm_setzero_si128();
+}
+#else
+typedef uint64_t BitboardVector;
+const int bitboardVectorWords = 1;
+inline BitboardVector bitboardLoad(const uint64_t* p)
+{
+  return *p;
+}
+inline void bitboardStore(uint64_t* p, BitboardVector v)
+{
+  *p = v;
+}
+inline BitboardVector bitboardAnd(BitboardVector a, BitboardVector b)
+{
+  return a & b;
+}
+inline BitboardVector bitboardOr(BitboardVector a, BitboardVector b)
+{
+  return a | b;
+}
+inline BitboardVector bitboardXor(BitboardVector a, BitboardVector b)
+{
+  return a ^ b;
+}
+inline BitboardVector bitboardAndNot(BitboardVector a, BitboardVector b)
+{
+  return ~a & b;
+}
+inline BitboardVector bitboardZero()
+{
+  return 0;
+}
+#endif
+
+// Shift of a bitboard by a signed number of bits, split into whole words and remaining bits.
+struct BitboardShift
+{
+  int words;
+  int bits;
+  BitboardShift() : words(0), bits(0) { }
+  BitboardShift(const int shift)
+  {
+    words = shift >= 0 ? shift / 64 : -((-shift + 63) / 64);
+    bits = shift - words * 64;
+  }
+};
+
+// Loads vector which bit p equals bit (p + shift) of data.
+// Words in range [-|shift.words| - 1, words + |shift.words| + 1) must be readable.
+inline BitboardVector bitboardLoadShifted(const uint64_t* data, const BitboardShift& shift)
+{
+#if defined(__AVX2__)
+  return _mm256_or_si256(_mm256_srl_epi64(bitboardLoad(data + shift.words), _mm_cvtsi32_si128(shift.bits)),
+                         _mm256_sll_epi64(bitboardLoad(data + shift.words + 1), _mm_cvtsi32_si128(64 - shift.bits)));
+#elif defined(__SSE2__)
+  return _mm_or_si128(_mm_srl_epi64(bitboardLoad(data + shift.words), _mm_cvtsi32_si128(shift.bits)),
+                      _mm_sll_epi64(bitboardLoad(data + shift.words + 1), _mm_cvtsi32_si128(64 - shift.bits)));
+#else
+  if (shift.bits == 0)
+    return data[shift.words];
+  return (data[shift.words] >> shift.bits) | (data[shift.words + 1] << (64 - shift.bits));
+#endif
+}
+
+// Set of board positions stored one bit per position.
+// Storage is padded on both sides, so it can be read shifted by up to maxShift positions.
+class Bitboard
+{
+private:
+  // Number of positions.
+  int _size;
+  // Number of data words, multiple of vector width.
+  int _words;
+  // Number of padding words on each side.
+  int _pad;
+  // Allocated memory including padding.
+  uint64_t* _buffer;
+  // First data word.
+  uint64_t* _data;
+
+public:
+  Bitboard(const int size, const int maxShift)
+  {
+    _size = size;
+    _words = ((size + 63) / 64 + bitboardVectorWords - 1) / bitboardVectorWords * bitboardVectorWords;
+    _pad = maxShift / 64 + 2;
+    _buffer = new uint64_t[_words + 2 * _pad];
+    fill_n(_buffer, _words + 2 * _pad, 0);
+    _data = _buffer + _pad;
+  }
+  Bitboard(const Bitboard &other)
+  {
+    _size = other._size;
+    _words = other._words;
+    _pad = other._pad;
+    _buffer = new uint64_t[_words + 2 * _pad];
+    copy_n(other._buffer, _words + 2 * _pad, _buffer);
+    _data = _buffer + _pad;
+  }
+  ~Bitboard()
+  {
+    delete[] _buffer;
+  }
+  int getSize() const
+  {
+    return _size;
+  }
+  int getWords() const
+  {
+    return _words;
+  }
+  const uint64_t* getData() const
+  {
+    return _data;
+  }
+  uint64_t* getData()
+  {
+    return _data;
+  }
+  bool test(const int pos) const
+  {
+    return (_data[pos >> 6] >> (pos & 63) & 1) != 0;
+  }
+  void set(const int pos)
+  {
+    _data[pos >> 6] |= uint64_t(1) << (pos & 63);
+  }
+  void clear(const int pos)
+  {
+    _data[pos >> 6] &= ~(uint64_t(1) << (pos & 63));
+  }
+  void assign(const int pos, const bool value)
+  {
+    _data[pos >> 6] = (_data[pos >> 6] & ~(uint64_t(1) << (pos & 63))) | (uint64_t(value) << (pos & 63));
+  }
+  void reset()
+  {
+    fill_n(_data, _words, 0);
+  }
+  // Clears words [beginWord, endWord).
+  void reset(const int beginWord, const int endWord)
+  {
+    for (int i = beginWord; i < endWord; i++)
+      _data[i] = 0;
+  }
+  void assign(const Bitboard &other)
+  {
+    copy_n(other._data, _words, _data);
+  }
+  // Number of set positions.
+  int count() const
+  {
+    return count(0, _words);
+  }
+  // Number of set positions in words [beginWord, endWord).
+  int count(const int beginWord, const int endWord) const
+  {
+    int result = 0;
+    for (int i = beginWord; i < endWord; i++)
+      result += __builtin_popcountll(_data[i]);
+    return result;
+  }
+  // Assigns union of two bitboards of the same size.
+  void assignOr(const Bitboard &a, const Bitboard &b)
+  {
+    assignOr(a, b, 0, _words);
+  }
+  // Assigns union of two bitboards of the same size in words [beginWord, endWord), multiples of vector width.
+  void assignOr(const Bitboard &a, const Bitboard &b, const int beginWord, const int endWord)
+  {
+    for (int i = beginWord; i < endWord; i += bitboardVectorWords)
+      bitboardStore(_data + i, bitboardOr(bitboardLoad(a._data + i), bitboardLoad(b._data + i)));
+  }
+  // Assigns intersection of two bitboards of the same size.
+  void assignAnd(const Bitboard &a, const Bitboard &b)
+  {
+    assignAnd(a, b, 0, _words);
+  }
+  // Assigns intersection of two bitboards of the same size in words [beginWord, endWord), multiples of vector width.
+  void assignAnd(const Bitboard &a, const Bitboard &b, const int beginWord, const int endWord)
+  {
+    for (int i = beginWord; i < endWord; i += bitboardVectorWords)
+      bitboardStore(_data + i, bitboardAnd(bitboardLoad(a._data + i), bitboardLoad(b._data + i)));
+  }
+  // Iterator over set positions in ascending order.
+  class Iterator
+  {
+  private:
+    const uint64_t* _data;
+    int _word;
+    int _words;
+    uint64_t _bits;
+    void skipEmpty()
+    {
+      while (_bits == 0 && ++_word < _words)
+        _bits = _data[_word];
+    }
+  public:
+    Iterator(const uint64_t* data, const int word, const int words) : _data(data), _word(word), _words(words), _bits(0)
+    {
+      if (word < words)
+      {
+        _bits = data[word];
+        skipEmpty();
+      }
+    }
+    int operator*() const
+    {
+      return _word * 64 + __builtin_ctzll(_bits);
+    }
+    Iterator& operator++()
+    {
+      _bits &= _bits - 1;
+      skipEmpty();
+      return *this;
+    }
+    bool operator!=(const Iterator &other) const
+    {
+      return _word != other._word || _bits != other._bits;
+    }
+  };
+  Iterator begin() const
+  {
+    return Iterator(_data, 0, _words);
+  }
+  Iterator end() const
+  {
+    return Iterator(_data, _words, _words);
+  }
+  // Set positions in words [beginWord, endWord), usable in range-based for.
+  class Range
+  {
+  private:
+    const uint64_t* _data;
+    int _beginWord;
+    int _endWord;
+  public:
+    Range(const uint64_t* data, const int beginWord, const int endWord) : _data(data), _beginWord(beginWord), _endWord(endWord) { }
+    Iterator begin() const
+    {
+      return Iterator(_data, _beginWord, _endWord);
+    }
+    Iterator end() const
+    {
+      return Iterator(_data, _endWord, _endWord);
+    }
+  };
+  Range range(const int beginWord, const int endWord) const
+  {
+    return Range(_data, beginWord, endWord);
+  }
+};
+
+// Sets positions i of result in words [beginWord, endWord) for which (bytes[i] & mask) == value, clears all other positions there.
+// result must have size at least size.
+inline void bitboardFromBytes(const uint8_t* bytes, const int size, const uint8_t mask, const uint8_t value, Bitboard& result, const int beginWord, const int endWord)
+{
+  uint64_t* dst = result.getData();
+  for (int i = beginWord; i < endWord; i++)
+  {
+    int firstPos = i * 64;
+    uint64_t word = 0;
+    int j = 0;
+#if defined(__AVX2__)
+    const __m256i vectorMask = _mm256_set1_epi8(static_cast<char>(mask));
+    const __m256i vectorValue = _mm256_set1_epi8(static_cast<char>(value));
+    for (; j < 64 && firstPos + j + 32 <= size; j += 32)
+    {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + firstPos + j));
+      uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(v, vectorMask), vectorValue)));
+      word |= uint64_t(bits) << j;
+    }
+#elif defined(__SSE2__)
+    const __m128i vectorMask = _mm_set1_epi8(static_cast<char>(mask));
+    const __m128i vectorValue = _mm_set1_epi8(static_cast<char>(value));
+    for (; j < 64 && firstPos + j + 16 <= size; j += 16)
+    {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + firstPos + j));
+      uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, vectorMask), vectorValue)));
+      word |= uint64_t(bits) << j;
+    }
+#endif
+    for (; j < 64 && firstPos + j < size; j++)
+      if ((bytes[firstPos + j] & mask) == value)
+        word |= uint64_t(1) << j;
+    dst[i] = word;
+  }
+}
+
+// Sets positions i of result for which (bytes[i] & mask) == value, clears all other positions.
+inline void bitboardFromBytes(const uint8_t* bytes, const int size, const uint8_t mask, const uint8_t value, Bitboard& result)
+{
+  bitboardFromBytes(bytes, size, mask, value, result, 0, result.getWords());
+}
+
+/* Kernels over a board. stride is the distance between vertically adjacent positions.
+   Range versions process words [beginWord, endWord), which must be multiples of vector width,
+   and write counts of position pos to counts[pos - beginWord * 64]. */
+
+// Adds one bit plane to a bit-sliced counter (planes[0] is the least significant).
+inline void bitboardCounterAdd(BitboardVector* planes, const int planesCount, BitboardVector value)
+{
+  for (int i = 0; i < planesCount - 1; i++)
+  {
+    BitboardVector carry = bitboardAnd(planes[i], value);
+    planes[i] = bitboardXor(planes[i], value);
+    value = carry;
+  }
+  planes[planesCount - 1] = bitboardOr(planes[planesCount - 1], value);
+}
+
+// Writes counter stored in bit planes as one byte per position.
+inline void bitboardExpandCounter(const uint64_t* planes, const int planesCount, const int firstPos, const int size, uint8_t* counts)
+{
+  for (int chunk = 0; chunk < 64 && firstPos + chunk < size; chunk += 8)
+  {
+#if defined(__BMI2__)
+    uint64_t bytes = 0;
+    for (int i = 0; i < planesCount; i++)
+      bytes |= _pdep_u64((planes[i] >> chunk) & 0xFF, 0x0101010101010101ULL) << i;
+    if (firstPos + chunk + 8 <= size)
+    {
+      memcpy(counts + firstPos + chunk, &bytes, 8);
+      continue;
+    }
+#endif
+    for (int j = chunk; j < chunk + 8 && firstPos + j < size; j++)
+    {
+      uint8_t count = 0;
+      for (int i = 0; i < planesCount; i++)
+        count |= ((planes[i] >> j) & 1) << i;
+      counts[firstPos + j] = count;
+    }
+  }
+}
+
+// Neighbour offsets in order n, s, w, e, nw, ne, sw, se.
+inline void bitboardNeighbourShifts(const int stride, BitboardShift* shifts)
+{
+  const int offsets[] = { -stride, stride, -1, 1, -stride - 1, -stride + 1, stride - 1, stride + 1 };
+  for (int i = 0; i < 8; i++)
+    shifts[i] = BitboardShift(offsets[i]);
+}
+
+// Marks positions which have at least one set neighbour.
+inline void bitboardNearMask(const Bitboard& occupied, const int stride, Bitboard& result, const int beginWord, const int endWord)
+{
+  BitboardShift shifts[8];
+  bitboardNeighbourShifts(stride, shifts);
+  const uint64_t* src = occupied.getData();
+  uint64_t* dst = result.getData();
+  for (int i = beginWord; i < endWord; i += bitboardVectorWords)
+  {
+    BitboardVector acc = bitboardZero();
+    for (int j = 0; j < 8; j++)
+      acc = bitboardOr(acc, bitboardLoadShifted(src + i, shifts[j]));
+    bitboardStore(dst + i, acc);
+  }
+}
+
+inline void bitboardNearMask(const Bitboard& occupied, const int stride, Bitboard& result)
+{
+  bitboardNearMask(occupied, stride, result, 0, occupied.getWords());
+}
+
+// Writes number of set neighbours of every position.
+inline void bitboardNearCounts(const Bitboard& occupied, const int stride, uint8_t* counts, const int beginWord, const int endWord)
+{
+  BitboardShift shifts[8];
+  bitboardNeighbourShifts(stride, shifts);
+  const uint64_t* src = occupied.getData();
+  const int endPos = min(occupied.getSize(), endWord * 64);
+  for (int i = beginWord; i < endWord; i += bitboardVectorWords)
+  {
+    BitboardVector planes[4] = { bitboardZero(), bitboardZero(), bitboardZero(), bitboardZero() };
+    for (int j = 0; j < 8; j++)
+      bitboardCounterAdd(planes, 4, bitboardLoadShifted(src + i, shifts[j]));
+    uint64_t words[4][bitboardVectorWords];
+    for (int k = 0; k < 4; k++)
+      bitboardStore(words[k], planes[k]);
+    for (int w = 0; w < bitboardVectorWords && (i + w) * 64 < endPos; w++)
+    {
+      const uint64_t wordPlanes[4] = { words[0][w], words[1][w], words[2][w], words[3][w] };
+      bitboardExpandCounter(wordPlanes, 4, (i + w - beginWord) * 64, endPos - beginWord * 64, counts);
+    }
+  }
+}
+
+inline void bitboardNearCounts(const Bitboard& occupied, const int stride, uint8_t* counts)
+{
+  bitboardNearCounts(occupied, stride, counts, 0, occupied.getWords());
+}
+
+// Writes number of groups of set neighbours of every position.
+// For every side it counts the side neighbour being clear while the previous (clockwise) diagonal or side neighbour is set.
+inline void bitboardNearGroups(const Bitboard& occupied, const int stride, uint8_t* counts, const int beginWord, const int endWord)
+{
+  BitboardShift n(-stride), s(stride), w(-1), e(1), nw(-stride - 1), ne(-stride + 1), sw(stride - 1), se(stride + 1);
+  const uint64_t* src = occupied.getData();
+  const int endPos = min(occupied.getSize(), endWord * 64);
+  for (int i = beginWord; i < endWord; i += bitboardVectorWords)
+  {
+    const uint64_t* p = src + i;
+    BitboardVector vn = bitboardLoadShifted(p, n), vs = bitboardLoadShifted(p, s);
+    BitboardVector vw = bitboardLoadShifted(p, w), ve = bitboardLoadShifted(p, e);
+    BitboardVector planes[3] = { bitboardZero(), bitboardZero(), bitboardZero() };
+    bitboardCounterAdd(planes, 3, bitboardAndNot(vw, bitboardOr(bitboardLoadShifted(p, nw), vn)));
+    bitboardCounterAdd(planes, 3, bitboardAndNot(vs, bitboardOr(bitboardLoadShifted(p, sw), vw)));
+    bitboardCounterAdd(planes, 3, bitboardAndNot(ve, bitboardOr(bitboardLoadShifted(p, se), vs)));
+    bitboardCounterAdd(planes, 3, bitboardAndNot(vn, bitboardOr(bitboardLoadShifted(p, ne), ve)));
+    uint64_t words[3][bitboardVectorWords];
+    for (int k = 0; k < 3; k++)
+      bitboardStore(words[k], planes[k]);
+    for (int j = 0; j < bitboardVectorWords && (i + j) * 64 < endPos; j++)
+    {
+      const uint64_t wordPlanes[3] = { words[0][j], words[1][j], words[2][j] };
+      bitboardExpandCounter(wordPlanes, 3, (i + j - beginWord) * 64, endPos - beginWord * 64, counts);
+    }
+  }
+}
+
+inline void bitboardNearGroups(const Bitboard& occupied, const int stride, uint8_t* counts)
+{
+  bitboardNearGroups(occupied, stride, counts, 0, occupied.getWords());
+}
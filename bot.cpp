@@ -12,11 +12,11 @@
 
 using namespace std;
 
-Bot::Bot(const int width, const int height, const BeginPattern beginPattern, int64_t seed)
+Bot::Bot(const int width, const int height, const BeginPattern beginPattern, const SurroundCondition surCond, int64_t seed)
 {
   _gen = new mt19937_64(seed);
-  _zobrist = new Zobrist((width + 2) * (height + 2), _gen);
-  _field = new Field(width, height, beginPattern, _zobrist);
+  _zobrist = new Zobrist(2 * (width + 2) * (height + 2), _gen);
+  _field = new Field(width, height, beginPattern, _zobrist, surCond);
   _uctRoot = initUct(_field);
 }
 
@@ -63,10 +63,7 @@ void Bot::setPlayer(int player)
 
 bool Bot::isFieldOccupied() const
 {
-  for (int i = _field->minPos(); i <= _field->maxPos(); i++)
-    if (_field->isPuttingAllowed(i))
-      return false;
-  return true;
+  return _field->isFull();
 }
 
 bool Bot::boundaryCheck(int& x, int& y) const
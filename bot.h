@@ -24,7 +24,7 @@ private:
   bool isFieldOccupied() const;
   bool boundaryCheck(int& x, int& y) const;
 public:
-  Bot(const int width, const int height, const BeginPattern beginPattern, int64_t seed);
+  Bot(const int width, const int height, const BeginPattern beginPattern, const SurroundCondition surCond, int64_t seed);
   ~Bot();
   bool doStep(int x, int y, int player);
   bool undoStep();
@@ -1,10 +1,19 @@
 ﻿#pragma once
 
-// Правила обработки пустых баз.
+// Правило обработки пустых баз по умолчанию (см. SurroundCondition), само правило задается для каждого поля.
 // STANDART = 0 - если PlayerRed ставит в пустую базу и ничего не обводит, то PlayerBlack обводит эту территорию.
 // ALWAYS = 1 - обводить базу, даже если нет вражеских точек внутри.
 // ALWAYS_ENEMY = 2 - обводит всегда PlayerBlack, если PlayerRed поставил точку в пустую базу.
+#ifndef SUR_COND
 #define SUR_COND 0
+#endif
+
+// Ширина ключа Zobrist.
+// 0 - только 64-битный хеш.
+// 1 - дополнительно 64-битный замок, вычисляемый вместе с хешем (128-битный ключ), для проверки совпадений в больших хеш-таблицах.
+#ifndef ZOBRIST_LOCK
+#define ZOBRIST_LOCK 0
+#endif
 
 // Включает сортировку по вероятностям для улучшения альфабета-отсечения.
 #define ALPHABETA_SORT 0
@@ -48,6 +57,8 @@
 #define SEARCH_WITH_COMPLEXITY_TYPE 3
 #define SEARCH_WITH_TIME_TYPE 2
 
+// Траектории хранят точки в массивах, размер которых определяется большей из MAX_MINIMAX_DEPTH и MAX_MTDF_DEPTH,
+// поэтому minimax, MTD(f) и Trajectories::setDepth молча ограничивают ею большую запрошенную глубину.
 #define MIN_MINIMAX_DEPTH 0
 #define MAX_MINIMAX_DEPTH 10
 #define DEFAULT_MINIMAX_DEPTH 8
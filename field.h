@@ -4,11 +4,14 @@
 #include "basic_types.h"
 #include "player.h"
 #include "zobrist.h"
+#include "bitboard.h"
+#include "visit_marks.h"
+#include "neighbourhood.h"
 #include <list>
 #include <vector>
 #include <algorithm>
-#include <functional>
 #include <utility>
+#include <memory>
 
 using namespace std;
 
@@ -30,36 +33,142 @@ private:
   static const int boundBit = 8;
   // Бит, указывающий на пустую базу.
   static const int emptyBaseBit = 16;
-  // Бит для временных пометок полей.
-  static const int tagBit = 32;
   // Бит, которым помечаются границы поля.
+  // Старший используемый бит - состояние поля хранится в PointState.
   static const int badBit = 64;
   static const int enableMask = badBit | surBit | putBit | playerBit;
   static const int boundMask = enableMask | boundBit;
+  // Во сколько раз откат одной записи журнала дороже копирования состояния одной точки (с учетом пересчета битбордов).
+  // Если откат к контрольной точке по журналу дороже копирования всего поля, то поле копируется.
+  static const int checkpointReplayCost = 100;
+  // Количество слов битбордов в плитке активной области (кратно ширине вектора).
+  static const int activeTileWords = bitboardVectorWords;
 
   /** Fields **/
 
   vector<BoardChange> _changes;
+  // Journal of points changes of all moves (position - value before change).
+  // Журнал изменений точек всех ходов (координата - значение до изменения).
+  vector<pair<int, PointState>> _journal;
   // Main points array (game board).
   // Основной массив точек (игровая доска).
-  int* _points;
+  PointState* _points;
   // Real field width.
   // Действительная ширина поля.
   int _width;
   // Real field height.
   // Действительная высота поля.
   int _height;
+  // Distance between vertically adjacent positions.
+  // Расстояние между соседними по вертикали позициями.
+  int _stride;
+  // Coordinates of every position, so that conversion from position needs no division.
+  // The table is shared by all copies of the field, _posX and _posY point into it.
+  // Координаты каждой позиции, чтобы преобразование из позиции обходилось без деления.
+  // Таблица общая для всех копий поля, _posX и _posY указывают в неё.
+  shared_ptr<const FieldCoordinates> _coordinates;
+  const int16_t* _posX;
+  const int16_t* _posY;
   // Current player color.
   // Текущий цвет игроков.
   int _player;
   // Capture points count.
   // Количество захваченных точек.
   int _captureCount[2];
+  // Правило обработки пустых баз.
+  SurroundCondition _surCond;
+  // Проверки окружений (checkClosure), инстанцированные для правила _surCond.
+  // Выбираются один раз при создании поля, поэтому ходы не ветвятся по правилу.
+  int (Field::*_applyClosure)(const int, const int);
+  int (Field::*_countClosure)(const int, const int);
   Zobrist* _zobrist;
   int64_t _hash;
+#if ZOBRIST_LOCK
+  // Замок хеша - второй независимый Zobrist-хеш позиции, вместе с _hash образует 128-битный ключ.
+  int64_t _hashLock;
+#endif
+  // Number of maintained symmetric images of the position (8 on square board, 4 otherwise), 0 if they are not maintained.
+  // They are opt-in (enableSymmetryHashes): no cache or transposition table uses canonical hashes yet.
+  // Количество поддерживаемых симметричных отображений позиции (8 на квадратной доске, 4 на прямоугольной), 0 - если не поддерживаются.
+  int _symmetriesCount;
+  // Images of every position under every symmetry except identity.
+  // Образы каждой позиции при каждой симметрии, кроме тождественной.
+  int* _symmetryPos[8];
+  // Hashes of symmetric images of the position. Image 0 is the position itself, its hash is _hash.
+  // Хеши симметричных отображений позиции. Отображение 0 - сама позиция, её хеш - _hash.
+  int64_t _symmetryHashes[8];
+  // Hashes of symmetric images before every move made since _symmetryMovesBegin.
+  // Хеши симметричных отображений перед каждым ходом, сделанным после _symmetryMovesBegin.
+  vector<int64_t> _symmetryHashesHistory;
+  int _symmetryMovesBegin;
   // History points sequance.
   // Последовательность поставленных точек.
   vector<int> _pointsSeq;
+  // Queue for wave algorithm (breadth-first search), reused by all waves.
+  // Очередь для волнового алгоритма (обхода в ширину), общая для всех обходов.
+  int* _waveQueue;
+  // Пометки посещенных полей обходов и построения цепочек (вместо временных битов в _points).
+  VisitMarks* _marks;
+  // Last chain built by buildChain.
+  // Последняя цепочка, построенная buildChain.
+  int* _chain;
+  int _chainLength;
+  // Bounding box of last chain.
+  // Ограничивающий прямоугольник последней цепочки.
+  int _chainMinX, _chainMaxX, _chainMinY, _chainMaxY;
+  // Bitboards of not captured points of each player.
+  // Битборды незахваченных точек каждого игрока.
+  Bitboard* _occupied[2];
+  // Bitboard of fields where putting is allowed.
+  // Битборд полей, в которые можно поставить точку.
+  Bitboard* _free;
+  // Number of fields where putting is allowed.
+  // Количество полей, в которые можно поставить точку.
+  int _freeCount;
+  // Bitboards of fields near not captured points of each player.
+  // Битборды полей рядом с незахваченными точками каждого игрока.
+  Bitboard* _near[2];
+  // Parents in disjoint sets of 8-connected points of one player. Captured points are never removed from the sets,
+  // so points in different sets are not connected in any way, and no ring can go through both of them.
+  // Родители в системе непересекающихся множеств 8-связных точек одного игрока. Захваченные точки из множеств не удаляются,
+  // поэтому точки из разных множеств никак не связаны, и никакое окружение не может пройти через них обе.
+  int* _groupParent;
+  // Ranks of sets roots.
+  // Ранги корней множеств.
+  uint8_t* _groupRank;
+  // Для каждого поля пустой базы - цепочка, окружившая её: начало * 8 + направление (NeighbourDirection) второй точки.
+  // 0 - цепочка неизвестна (поле 0 - граница). Не откатываются вместе с ходами, поэтому перед использованием цепочка
+  // проверяется заново. Создаются при появлении первой пустой базы и не копируются в снимки: для баз, окруживших
+  // до копирования, снимок обходит поле, как без известной цепочки.
+  int* _emptyBaseChains;
+  // Journal of unions of sets of all moves (joined root * 2 + 1 if rank of the new root was increased).
+  // Журнал объединений множеств всех ходов (присоединённый корень * 2 + 1, если ранг нового корня увеличился).
+  vector<int> _groupJournal;
+  // Whether _near is up to date. Stones are added to it incrementally, removed stones are recomputed in a small range,
+  // after bulk changes it is rebuilt on demand.
+  // Актуален ли _near. Точки добавляются в него по одной, удалённые пересчитываются в небольшом диапазоне,
+  // после массовых изменений он перестраивается по запросу.
+  bool _nearValid[2];
+  // Bitmask of active tiles. A tile is activeTileWords words of bitboards, it is active if it contains a point,
+  // a neighbour of a point or a surrounded field. Outside active tiles states of fields and bitboards are the initial ones,
+  // so board scans, rebuilds of bitboards and checkpoints touch only active tiles, and their cost grows with the number
+  // of points instead of the board area. Arrays of the field are still allocated and copied for the whole board.
+  // Битовая маска активных плиток. Плитка - activeTileWords слов битбордов, она активна, если содержит точку,
+  // соседа точки или окружённое поле. Вне активных плиток состояния полей и битборды исходные, поэтому обходы поля,
+  // перестроения битбордов и контрольные точки затрагивают только активные плитки, и их стоимость растёт с количеством
+  // точек, а не с площадью доски. Массивы поля по-прежнему выделяются и копируются для всей доски.
+  vector<uint64_t> _activeTiles;
+  int _tilesCount;
+  // Journal of tiles which became active on all moves, so that they are deactivated on undo.
+  // Журнал плиток, ставших активными на всех ходах, чтобы при откате они становились неактивными.
+  vector<int> _activeJournal;
+  // Neighbourhood masks of all fields for each player (see NeighbourDirection), updated with _occupied.
+  // Маски соседей всех полей для каждого игрока (см. NeighbourDirection), обновляются вместе с _occupied.
+  uint8_t* _neighbourMasks[2];
+  // Смещения соседей в порядке NeighbourDirection.
+  int _neighbourOffsets[8];
+  // Слова битборда точек игрока до его перестроения, по ним находятся изменившиеся точки.
+  vector<uint64_t> _oldOccupied;
 
   /** Private methods **/
 
@@ -185,75 +294,21 @@ private:
   }
   // Возвращает количество групп точек рядом с CenterPos.
   // InpChainPoints - возможные точки цикла, InpSurPoints - возможные окруженные точки.
+  // enableCond - putBit | игрок, точки которого образуют группы.
   int getInputPoints(const int centerPos, const int enableCond, int inpChainPoints[], int inpSurPoints[]) const
   {
-    int result = 0;
-    if (isNotEnable(w(centerPos), enableCond))
+    const uint8_t mask = _neighbourMasks[enableCond & playerBit][centerPos];
+    const int result = neighbourhoodTables.groups[mask];
+    for (int i = 0; i < result; i++)
     {
-      if (isEnable(nw(centerPos), enableCond))
-      {
-        inpChainPoints[0] = nw(centerPos);
-        inpSurPoints[0] = w(centerPos);
-        result++;
-      }
-      else if (isEnable(n(centerPos), enableCond))
-      {
-        inpChainPoints[0] = n(centerPos);
-        inpSurPoints[0] = w(centerPos);
-        result++;
-      }
-    }
-    if (isNotEnable(s(centerPos), enableCond))
-    {
-      if (isEnable(sw(centerPos), enableCond))
-      {
-        inpChainPoints[result] = sw(centerPos);
-        inpSurPoints[result] = s(centerPos);
-        result++;
-      }
-      else if (isEnable(w(centerPos), enableCond))
-      {
-        inpChainPoints[result] = w(centerPos);
-        inpSurPoints[result] = s(centerPos);
-        result++;
-      }
-    }
-    if (isNotEnable(e(centerPos), enableCond))
-    {
-      if (isEnable(se(centerPos), enableCond))
-      {
-        inpChainPoints[result] = se(centerPos);
-        inpSurPoints[result] = e(centerPos);
-        result++;
-      }
-      else if (isEnable(s(centerPos), enableCond))
-      {
-        inpChainPoints[result] = s(centerPos);
-        inpSurPoints[result] = e(centerPos);
-        result++;
-      }
-    }
-    if (isNotEnable(n(centerPos), enableCond))
-    {
-      if (isEnable(ne(centerPos), enableCond))
-      {
-        inpChainPoints[result] = ne(centerPos);
-        inpSurPoints[result] = n(centerPos);
-        result++;
-      }
-      else if (isEnable(e(centerPos), enableCond))
-      {
-        inpChainPoints[result] = e(centerPos);
-        inpSurPoints[result] = n(centerPos);
-        result++;
-      }
+      inpChainPoints[i] = centerPos + _neighbourOffsets[neighbourhoodTables.inputChainDirs[mask][i]];
+      inpSurPoints[i] = centerPos + _neighbourOffsets[neighbourhoodTables.inputSurDirs[mask][i]];
     }
     return result;
   }
-  IntersectionState getIntersectionState(const int pos, const int nextPos) const
+  IntersectionState getIntersectionState(const Point& a, const int nextPos) const
   {
-    Point a, b;
-    toXY(pos, a.x, a.y);
+    Point b;
     toXY(nextPos, b.x, b.y);
     if (b.x <= a.x)
       switch (b.y - a.y)
@@ -291,12 +346,251 @@ private:
       break;
     }
   }
+  // Обновляет битборды после изменения поля pos из состояния oldState в текущее.
+  // Должна вызываться после каждого изменения поля, влияющего на занятость или возможность поставить точку.
+  void updateBitboards(const int pos, const PointState oldState)
+  {
+    PointState state = _points[pos];
+    if (((oldState ^ state) & enableMask) == 0)
+      return;
+    bool wasFree = (oldState & (putBit | surBit | badBit)) == 0;
+    bool free = (state & (putBit | surBit | badBit)) == 0;
+    _free->assign(pos, free);
+    _freeCount += int(free) - int(wasFree);
+    for (int player = playerRed; player <= playerBlack; player++)
+    {
+      bool wasOccupied = (oldState & enableMask) == (putBit | player);
+      bool occupied = (state & enableMask) == (putBit | player);
+      _occupied[player]->assign(pos, occupied);
+      if (occupied == wasOccupied)
+        continue;
+      toggleNeighbourMasks(pos, player);
+      if (occupied)
+        extendActive(pos);
+      if (!_nearValid[player])
+        continue;
+      if (!occupied)
+      {
+        // Маска соседей удалённой точки пересчитывается в нескольких соседних строках.
+        updateNear(player, pos, pos);
+      }
+      else
+      {
+        _near[player]->set(n(pos));
+        _near[player]->set(s(pos));
+        _near[player]->set(w(pos));
+        _near[player]->set(e(pos));
+        _near[player]->set(nw(pos));
+        _near[player]->set(ne(pos));
+        _near[player]->set(sw(pos));
+        _near[player]->set(se(pos));
+      }
+    }
+  }
+  // Возвращает корень множества точек, в которое входит точка pos.
+  int findGroup(int pos) const
+  {
+    while (_groupParent[pos] != pos)
+      pos = _groupParent[pos];
+    return pos;
+  }
+  // Отменяет объединения групп, записанные в журнал после groupJournalBegin.
+  void rollbackGroups(const int groupJournalBegin)
+  {
+    for (int i = static_cast<int>(_groupJournal.size()) - 1; i >= groupJournalBegin; i--)
+    {
+      int root = _groupJournal[i] >> 1;
+      if ((_groupJournal[i] & 1) != 0)
+        _groupRank[_groupParent[root]]--;
+      _groupParent[root] = root;
+    }
+    _groupJournal.resize(groupJournalBegin);
+  }
+  // Объединяет множества точек pos1 и pos2.
+  void unionGroups(const int pos1, const int pos2)
+  {
+    int root1 = findGroup(pos1);
+    int root2 = findGroup(pos2);
+    if (root1 == root2)
+      return;
+    if (_groupRank[root1] < _groupRank[root2])
+      swap(root1, root2);
+    _groupParent[root2] = root1;
+    bool rankIncreased = _groupRank[root1] == _groupRank[root2];
+    if (rankIncreased)
+      _groupRank[root1]++;
+    _groupJournal.push_back(root2 * 2 + rankIncreased);
+  }
+  // Добавляет поставленную точку pos игрока player в множества, объединяя её с соседними точками этого игрока.
+  void addToGroups(const int pos, const int player)
+  {
+    _groupParent[pos] = pos;
+    _groupRank[pos] = 0;
+    const int neighbours[] = { n(pos), s(pos), w(pos), e(pos), nw(pos), ne(pos), sw(pos), se(pos) };
+    for (int i = 0; i < 8; i++)
+      if ((_points[neighbours[i]] & (putBit | playerBit)) == (putBit | player))
+        unionGroups(pos, neighbours[i]);
+  }
+  // Проверяет, входят ли какие-нибудь две из точек points в одно множество.
+  // Если нет, то цепочка из поставленной рядом с ними точки не может вернуться в неё через другую точку, и окружений нет.
+  bool hasConnectedGroups(const int points[], const int count) const
+  {
+    int roots[4];
+    for (int i = 0; i < count; i++)
+    {
+      roots[i] = findGroup(points[i]);
+      for (int j = 0; j < i; j++)
+        if (roots[j] == roots[i])
+          return true;
+    }
+    return false;
+  }
+  // Первое слово битбордов, содержащее поле pos, выровненное на ширину вектора.
+  static int beginWord(const int pos)
+  {
+    return pos / 64 / bitboardVectorWords * bitboardVectorWords;
+  }
+  // Слово битбордов после слова, содержащего поле pos, выровненное на ширину вектора.
+  int endWord(const int pos) const
+  {
+    return min((pos / 64 / bitboardVectorWords + 1) * bitboardVectorWords, _free->getWords());
+  }
+  static int tileOf(const int pos)
+  {
+    return pos / 64 / activeTileWords;
+  }
+  bool isActiveTile(const int tile) const
+  {
+    return (_activeTiles[tile >> 6] >> (tile & 63) & 1) != 0;
+  }
+  // Делает активной плитку, содержащую поле pos.
+  void activateTile(const int pos)
+  {
+    int tile = tileOf(pos);
+    if (isActiveTile(tile))
+      return;
+    _activeTiles[tile >> 6] |= uint64_t(1) << (tile & 63);
+    _activeJournal.push_back(tile);
+  }
+  // Делает активными плитки поля pos и его соседей.
+  void extendActive(const int pos)
+  {
+    for (int row = pos - _stride; row <= pos + _stride; row += _stride)
+    {
+      activateTile(max(row - 1, 0));
+      activateTile(min(row + 1, getLength() - 1));
+    }
+  }
+  // Номер первой плитки, начиная с tile, активность которой равна active, или _tilesCount, если таких нет.
+  int findTile(const int tile, const bool active) const
+  {
+    for (int i = tile; i < _tilesCount; i = (i | 63) + 1)
+    {
+      uint64_t bits = (active ? _activeTiles[i >> 6] : ~_activeTiles[i >> 6]) & (~uint64_t(0) << (i & 63));
+      if (bits != 0)
+        return min((i & ~63) + __builtin_ctzll(bits), _tilesCount);
+    }
+    return _tilesCount;
+  }
+  // Делает неактивными плитки, ставшие активными после записи journalBegin журнала.
+  // Поля и битборды в них уже исходные, кроме недействительных _near, которые очищаются.
+  void restoreActive(const int journalBegin)
+  {
+    for (int i = static_cast<int>(_activeJournal.size()) - 1; i >= journalBegin; i--)
+    {
+      int tile = _activeJournal[i];
+      _activeTiles[tile >> 6] &= ~(uint64_t(1) << (tile & 63));
+      for (int player = playerRed; player <= playerBlack; player++)
+        _near[player]->reset(tile * activeTileWords, (tile + 1) * activeTileWords);
+    }
+    _activeJournal.resize(journalBegin);
+  }
+  // Исходное состояние поля pos: граница или пустое поле.
+  PointState initialState(const int pos) const
+  {
+    return _posX[pos] < 0 || _posX[pos] >= _width || _posY[pos] < 0 || _posY[pos] >= _height ? badBit : 0;
+  }
+  // Изменяет в масках соседей полей рядом с pos наличие на pos точки игрока player.
+  void toggleNeighbourMasks(const int pos, const int player)
+  {
+    for (int dir = 0; dir < 8; dir++)
+      _neighbourMasks[player][pos + _neighbourOffsets[dir]] ^= static_cast<uint8_t>(1 << ((dir + 4) % 8));
+  }
+  // Перестраивает битборд точек игрока player в словах [begin, end) и маски соседей изменившихся точек.
+  void rebuildOccupied(const int player, const int begin, const int end)
+  {
+    uint64_t* data = _occupied[player]->getData();
+    _oldOccupied.assign(data + begin, data + end);
+    bitboardFromBytes(_points, getLength(), enableMask, putBit | player, *_occupied[player], begin, end);
+    for (int i = begin; i < end; i++)
+      for (uint64_t changed = data[i] ^ _oldOccupied[i - begin]; changed != 0; changed &= changed - 1)
+        toggleNeighbourMasks(i * 64 + __builtin_ctzll(changed), player);
+  }
+  // Пересчитывает маску соседей игрока player для полей рядом с полями из [firstPos, lastPos].
+  void updateNear(const int player, const int firstPos, const int lastPos)
+  {
+    bitboardNearMask(*_occupied[player], _stride, *_near[player], beginWord(max(firstPos - _stride - 1, 0)), endWord(min(lastPos + _stride + 1, getLength() - 1)));
+  }
+  // Перестраивает битборды для полей из [firstPos, lastPos].
+  // После захвата области это дешевле, чем обновлять их для каждого изменённого поля.
+  void rebuildBitboards(const int firstPos, const int lastPos)
+  {
+    int begin = beginWord(firstPos);
+    int end = endWord(lastPos);
+    _freeCount -= _free->count(begin, end);
+    bitboardFromBytes(_points, getLength(), putBit | surBit | badBit, 0, *_free, begin, end);
+    rebuildOccupied(playerRed, begin, end);
+    rebuildOccupied(playerBlack, begin, end);
+    _freeCount += _free->count(begin, end);
+    for (int player = playerRed; player <= playerBlack; player++)
+      if (_nearValid[player])
+        updateNear(player, firstPos, lastPos);
+  }
+  // Перестраивает битборды во всех активных плитках.
+  void rebuildBitboards()
+  {
+    for (int begin = 0, end = 0; nextActiveRun(end, begin, end); )
+    {
+      _freeCount -= _free->count(begin, end);
+      bitboardFromBytes(_points, getLength(), putBit | surBit | badBit, 0, *_free, begin, end);
+      rebuildOccupied(playerRed, begin, end);
+      rebuildOccupied(playerBlack, begin, end);
+      _freeCount += _free->count(begin, end);
+    }
+    _nearValid[playerRed] = false;
+    _nearValid[playerBlack] = false;
+  }
   void updateHash(int pos, int player)
   {
-    if (player == 0)
-      _hash ^= _zobrist->getHash(pos);
-    else
-      _hash ^= _zobrist->getHash(getLength() + pos);
+    int offset = player == 0 ? 0 : getLength();
+    _hash ^= _zobrist->getHash(offset + pos);
+#if ZOBRIST_LOCK
+    _hashLock ^= _zobrist->getLock(offset + pos);
+#endif
+    for (int i = 1; i < _symmetriesCount; i++)
+      _symmetryHashes[i] ^= _zobrist->getHash(offset + _symmetryPos[i][pos]);
+  }
+  // Вычисляет хеши симметричных отображений позиции заново по всему полю.
+  // Поле входит в хеш игрока, которому принадлежит: незахваченная точка - своего игрока, захваченное поле - захватившего.
+  void recomputeSymmetryHashes()
+  {
+    for (int i = 1; i < _symmetriesCount; i++)
+      _symmetryHashes[i] = 0;
+    for (int pos = minPos(); pos <= maxPos(); pos++)
+    {
+      int owner;
+      if (isCaptured(pos))
+        owner = isPutted(pos) ? nextPlayer(getPlayer(pos)) : getPlayer(pos);
+      else if (isPutted(pos))
+        owner = getPlayer(pos);
+      else
+        continue;
+      int offset = owner == 0 ? 0 : getLength();
+      for (int i = 1; i < _symmetriesCount; i++)
+        _symmetryHashes[i] ^= _zobrist->getHash(offset + _symmetryPos[i][pos]);
+    }
+    _symmetryHashesHistory.clear();
+    _symmetryMovesBegin = getMovesCount();
   }
   // Удаляет пометку пустой базы с поля точек, начиная с позиции StartPos.
   void removeEmptyBase(const int startPos)
@@ -305,7 +599,7 @@ private:
     {
       if (isInEmptyBase(pos))
       {
-        _changes.back().changes.emplace(pos, _points[pos]);
+        _journal.emplace_back(pos, _points[pos]);
         clearEmptyBase(pos);
         return true;
       }
@@ -315,28 +609,40 @@ private:
       }
     });
   }
-  bool buildChain(const int startPos, const int enableCond, const int directionPos, list<int> &chain)
+  // Строит цепочку от startPos в направлении directionPos в буфер _chain.
+  // Возвращает true, если цепочка является окружением.
+  bool buildChain(const int startPos, const int enableCond, const int directionPos)
   {
-    chain.clear();
-    chain.push_back(startPos);
+    _chain[0] = startPos;
+    _chainLength = 1;
+    toXY(startPos, _chainMinX, _chainMinY);
+    _chainMaxX = _chainMinX;
+    _chainMaxY = _chainMinY;
     int pos = directionPos;
     int centerPos = startPos;
     // Площадь базы.
     int baseSquare = square(centerPos, pos);
+    _marks->clear();
     do
     {
-      if (isTagged(pos))
+      if (_marks->test(pos))
       {
-        while (chain.back() != pos)
+        while (_chain[_chainLength - 1] != pos)
         {
-          clearTag(chain.back());
-          chain.pop_back();
+          _chainLength--;
+          _marks->reset(_chain[_chainLength]);
         }
       }
       else
       {
-        setTag(pos);
-        chain.push_back(pos);
+        _marks->set(pos);
+        _chain[_chainLength++] = pos;
+        int x, y;
+        toXY(pos, x, y);
+        _chainMinX = min(_chainMinX, x);
+        _chainMaxX = max(_chainMaxX, x);
+        _chainMinY = min(_chainMinY, y);
+        _chainMaxY = max(_chainMaxY, y);
       }
       swap(pos, centerPos);
       pos = getFirstNextPos(centerPos, pos);
@@ -345,75 +651,109 @@ private:
       baseSquare += square(centerPos, pos);
     }
     while (pos != startPos);
-    for (auto i = chain.begin(); i != chain.end(); i++)
-      clearTag(*i);
-    return (baseSquare < 0 && chain.size() > 2);
-  }
-  void findSurround(list<int> &chain, int insidePoint, int player)
-  {
-    // Количество захваченных точек.
-    int curCaptureCount = 0; //captured
-    // Количество захваченных пустых полей.
-    int curFreedCount = 0;
-    list<int> surPoints;
-    // Помечаем точки цепочки.
-    for (auto i = chain.begin(); i != chain.end(); i++)
-      setTag(*i);
-    wave(insidePoint, [&, player](int pos)->bool
+    return (baseSquare < 0 && _chainLength > 2);
+  }
+  // Обходит область внутри последней построенной цепочки, содержащую insidePoint, и считает точки,
+  // которые захватит (captureCount) и освободит (freedCount) игрок player при её окружении, а также его незахваченные точки (ownCount).
+  // Окруженные поля остаются в очереди обхода. Возвращает количество окруженных полей.
+  int waveSurround(const int insidePoint, const int player, int& captureCount, int& freedCount, int& ownCount)
+  {
+    captureCount = 0;
+    freedCount = 0;
+    ownCount = 0;
+    // Помечаем точки цепочки, чтобы обход не выходил за неё.
+    _marks->clear();
+    for (int i = 0; i < _chainLength; i++)
+      _marks->set(_chain[i]);
+    return waveMarked(insidePoint, [&, player](int pos)->bool
     {
       if (isNotBound(pos, player | putBit | boundBit))
       {
         if (isPutted(pos))
         {
           if (getPlayer(pos) != player)
-            curCaptureCount++;
+            captureCount++;
           else if (isCaptured(pos))
-            curFreedCount++;
+            freedCount++;
+          else
+            ownCount++;
         }
-        surPoints.push_back(pos);
         return true;
       }
       else
       {
         return false;
       }
-    });
+    }, *_marks, _waveQueue);
+  }
+  // Возвращает изменение счета игрока player при окружении области внутри последней построенной цепочки, содержащей insidePoint.
+  // Поле не изменяется.
+  int countSurround(const int insidePoint, const int player)
+  {
+    int curCaptureCount, curFreedCount, curOwnCount;
+    waveSurround(insidePoint, player, curCaptureCount, curFreedCount, curOwnCount);
+    return curCaptureCount + curFreedCount;
+  }
+  // Окружает область внутри последней построенной цепочки, содержащую insidePoint.
+  // Возвращает изменение счета игрока player.
+  template<SurroundCondition surCond>
+  int findSurround(const int insidePoint, const int player)
+  {
+    int curCaptureCount, curFreedCount, curOwnCount;
+    int surPointsCount = waveSurround(insidePoint, player, curCaptureCount, curFreedCount, curOwnCount);
+    return applySurround<surCond>(player, surPointsCount, curCaptureCount, curFreedCount);
+  }
+  // Окружает область, найденную последним waveSurround (surPointsCount полей в очереди обхода).
+  // curCaptureCount - количество захваченных точек, curFreedCount - количество освобожденных точек.
+  // Возвращает изменение счета игрока player.
+  template<SurroundCondition surCond>
+  int applySurround(const int player, const int surPointsCount, const int curCaptureCount, const int curFreedCount)
+  {
+    const int* surPoints = _waveQueue;
     // Изменение счета игроков.
     _captureCount[player] += curCaptureCount;
     _captureCount[nextPlayer(player)] -= curFreedCount;
-#if SUR_COND != 1
-    if (curCaptureCount != 0) // Если захватили точки.
-#endif
+    if (surCond == SUR_COND_ALWAYS || curCaptureCount != 0) // Если захватили точки (или окружаем всегда).
     {
-      for (auto i = chain.begin(); i != chain.end(); i++)
+      for (int i = 0; i < _chainLength; i++)
       {
-        int pos = *i;
-        clearTag(pos);
+        int pos = _chain[i];
         // Добавляем в список изменений точки цепочки.
-        _changes.back().changes.emplace(pos, _points[pos]);
+        _journal.emplace_back(pos, _points[pos]);
         // Помечаем точки цепочки.
         setBound(pos);
       }
-      for (auto i = surPoints.begin(); i != surPoints.end(); i++)
+      for (int i = 0; i < surPointsCount; i++)
       {
-        int pos = *i;
-        _changes.back().changes.emplace(pos, _points[pos]);
+        int pos = surPoints[i];
+        _journal.emplace_back(pos, _points[pos]);
+        activateTile(pos);
+        // Ключи хеша меняются, только если поле переходит к игроку player от другого владельца:
+        // повторно окружённые поля, которые уже принадлежат ему, в хеше не меняются.
         if (!isPutted(pos))
         {
           if (!isCaptured(pos))
+          {
             setCaptured(pos);
-          else
+            updateHash(pos, player);
+          }
+          else if (getPlayer(pos) != player)
+          {
             updateHash(pos, nextPlayer(player));
+            updateHash(pos, player);
+          }
           setPlayer(pos, player);
-          updateHash(pos, player);
         }
         else
         {
           if (getPlayer(pos) != player)
           {
-            setCaptured(pos);
-            updateHash(pos, nextPlayer(player));
-            updateHash(pos, player);
+            if (!isCaptured(pos))
+            {
+              setCaptured(pos);
+              updateHash(pos, nextPlayer(player));
+              updateHash(pos, player);
+            }
           }
           else if (isCaptured(pos))
           {
@@ -423,57 +763,90 @@ private:
           }
         }
       }
+      rebuildBitboards(toPos(_chainMinX, _chainMinY), toPos(_chainMaxX, _chainMaxY));
     }
     else // Если ничего не захватили.
     {
-      for (auto i = chain.begin(); i != chain.end(); i++)
-        clearTag(*i);
-      for (auto i = surPoints.begin(); i != surPoints.end(); i++)
+      if (_emptyBaseChains == nullptr)
+      {
+        _emptyBaseChains = new int[getLength()];
+        fill_n(_emptyBaseChains, getLength(), 0);
+      }
+      int chainDirection = static_cast<int>(find(_neighbourOffsets, _neighbourOffsets + 8, _chain[1] - _chain[0]) - _neighbourOffsets);
+      int chainRecord = _chain[0] * 8 + chainDirection;
+      for (int i = 0; i < surPointsCount; i++)
       {
-        int pos = *i;
-        _changes.back().changes.emplace(pos, _points[pos]);
+        int pos = surPoints[i];
+        _journal.emplace_back(pos, _points[pos]);
+        activateTile(pos);
         if (!isPutted(pos))
         {
           setEmptyBase(pos);
           setPlayer(pos, player);
+          _emptyBaseChains[pos] = chainRecord;
         }
       }
     }
+    return curCaptureCount + curFreedCount;
   }
-  // Проверяет поставленную точку на наличие созданных ею окружений, и окружает, если они есть.
-  void checkClosure(const int startPos, const int player)
+  // Проверяет поставленную точку на наличие созданных ею окружений.
+  // Если apply, то окружает их, иначе только считает, не изменяя поле (кроме временных пометок).
+  // Возвращает изменение счета игрока player.
+  template<bool apply, SurroundCondition surCond>
+  int checkClosure(const int startPos, const int player)
   {
+    int result = 0;
     int inpPointsCount;
     int inpChainPoints[4], inpSurPoints[4];
-    list<int> chain;
     if (isInEmptyBase(startPos)) // Если точка поставлена в пустую базу.
     {
       if (getPlayer(startPos - 1) == getPlayer(startPos)) // Если поставили в свою пустую базу.
       {
-        clearEmptyBase(startPos);
-        return;
+        if (apply)
+          clearEmptyBase(startPos);
+        return 0;
       }
-#if SUR_COND != 2 // Если приоритет не всегда у врага.
-      inpPointsCount = getInputPoints(startPos, player | putBit, inpChainPoints, inpSurPoints);
-      if (inpPointsCount > 1)
+      // Если приоритет не всегда у врага, то сначала проверяем окружения поставленной точкой.
+      inpPointsCount = surCond != SUR_COND_ALWAYS_ENEMY ? getInputPoints(startPos, player | putBit, inpChainPoints, inpSurPoints) : 0;
+      if (inpPointsCount > 1 && hasConnectedGroups(inpChainPoints, inpPointsCount))
       {
         int chainsCount = 0;
         for (int i = 0; i < inpPointsCount; i++)
-          if (buildChain(startPos, getPlayer(startPos) | putBit, inpChainPoints[i], chain))
+          if (buildChain(startPos, getPlayer(startPos) | putBit, inpChainPoints[i]))
           {
-            findSurround(chain, inpSurPoints[i], player);
+            result += apply ? findSurround<surCond>(inpSurPoints[i], player) : countSurround(inpSurPoints[i], player);
             chainsCount++;
             if (chainsCount == inpPointsCount - 1)
               break;
           }
         if (chainsCount > 0)
         {
-          removeEmptyBase(startPos);
-          return;
+          if (apply)
+            removeEmptyBase(startPos);
+          return result;
+        }
+      }
+      // Сначала пробуем цепочку, окружившую эту пустую базу: если она всё ещё окружает точку, то обходить поле не нужно.
+      // Цепочка строится, только если её направление всё ещё входное для её начала, иначе обход цепочки может не завершиться.
+      int enemyCond = nextPlayer(player) | putBit;
+      int chainRecord = _emptyBaseChains != nullptr ? _emptyBaseChains[startPos] : 0;
+      int chainStart = chainRecord / 8;
+      if (isEnable(chainStart, enemyCond))
+      {
+        int chainDirection = chainStart + _neighbourOffsets[chainRecord % 8];
+        inpPointsCount = getInputPoints(chainStart, enemyCond, inpChainPoints, inpSurPoints);
+        if (find(inpChainPoints, inpChainPoints + inpPointsCount, chainDirection) != inpChainPoints + inpPointsCount &&
+            buildChain(chainStart, enemyCond, chainDirection) && isPointInsideChain(startPos))
+        {
+          // Если внутри есть точки хозяина базы, то они могли образовать более тесное окружение, которое найдет обход поля.
+          int curCaptureCount, curFreedCount, curOwnCount;
+          int surPointsCount = waveSurround(startPos, nextPlayer(player), curCaptureCount, curFreedCount, curOwnCount);
+          if (curOwnCount == 0)
+            return result - (apply ? applySurround<surCond>(nextPlayer(player), surPointsCount, curCaptureCount, curFreedCount) : curCaptureCount + curFreedCount);
         }
       }
-#endif
       int pos = startPos;
+      bool captured = false;
       do
       {
         pos--;
@@ -481,30 +854,57 @@ private:
           pos--;
         inpPointsCount = getInputPoints(pos, nextPlayer(player) | putBit, inpChainPoints, inpSurPoints);
         for (int i = 0; i < inpPointsCount; i++)
-          if (buildChain(pos, nextPlayer(player) | putBit, inpChainPoints[i], chain))
-            if (isPointInsideRing(startPos, chain))
+          if (buildChain(pos, nextPlayer(player) | putBit, inpChainPoints[i]))
+            if (isPointInsideChain(startPos))
             {
-              findSurround(chain, inpSurPoints[i], nextPlayer(player));
+              result -= apply ? findSurround<surCond>(inpSurPoints[i], nextPlayer(player)) : countSurround(inpSurPoints[i], nextPlayer(player));
+              captured = apply ? isCaptured(startPos) : true;
               break;
             }
-      } while (!isCaptured(startPos));
+      } while (!captured);
     }
     else
     {
       inpPointsCount = getInputPoints(startPos, player | putBit, inpChainPoints, inpSurPoints);
-      if (inpPointsCount > 1)
+      if (inpPointsCount > 1 && hasConnectedGroups(inpChainPoints, inpPointsCount))
       {
         int chainsCount = 0;
         for (int i = 0; i < inpPointsCount; i++)
-          if (buildChain(startPos, player | putBit, inpChainPoints[i], chain))
+          if (buildChain(startPos, player | putBit, inpChainPoints[i]))
           {
-            findSurround(chain, inpSurPoints[i], player);
+            result += apply ? findSurround<surCond>(inpSurPoints[i], player) : countSurround(inpSurPoints[i], player);
             chainsCount++;
             if (chainsCount == inpPointsCount - 1)
               break;
           }
       }
     }
+    return result;
+  }
+  // Заполняет смещения соседей в порядке NeighbourDirection.
+  void initNeighbourOffsets()
+  {
+    const int offsets[] = { -_stride, -_stride + 1, 1, _stride + 1, _stride, _stride - 1, -1, -_stride - 1 };
+    copy_n(offsets, 8, _neighbourOffsets);
+  }
+  void setSurroundCondition(const SurroundCondition surCond)
+  {
+    _surCond = surCond;
+    switch (surCond)
+    {
+    case SUR_COND_ALWAYS:
+      _applyClosure = &Field::checkClosure<true, SUR_COND_ALWAYS>;
+      _countClosure = &Field::checkClosure<false, SUR_COND_ALWAYS>;
+      break;
+    case SUR_COND_ALWAYS_ENEMY:
+      _applyClosure = &Field::checkClosure<true, SUR_COND_ALWAYS_ENEMY>;
+      _countClosure = &Field::checkClosure<false, SUR_COND_ALWAYS_ENEMY>;
+      break;
+    default:
+      _applyClosure = &Field::checkClosure<true, SUR_COND_STANDART>;
+      _countClosure = &Field::checkClosure<false, SUR_COND_STANDART>;
+      break;
+    }
   }
 
 public:
@@ -513,15 +913,47 @@ public:
 
   /* Constructors and destructor */
 
-  Field(const int width, const int height, const BeginPattern begin_pattern, Zobrist* zobrist)
+  Field(const int width, const int height, const BeginPattern begin_pattern, Zobrist* zobrist, const SurroundCondition surCond = static_cast<SurroundCondition>(SUR_COND))
   {
     _width = width;
     _height = height;
+    _stride = width + 2;
+    _coordinates = make_shared<const FieldCoordinates>(_stride, getLength());
+    _posX = _coordinates->x.data();
+    _posY = _coordinates->y.data();
     _player = playerRed;
     _captureCount[playerRed] = 0;
     _captureCount[playerBlack] = 0;
-    _points = new int[getLength()];
+    _points = new PointState[getLength()];
     fill_n(_points, getLength(), 0);
+    _waveQueue = new int[getLength()];
+    _marks = new VisitMarks(getLength());
+    _chain = new int[getLength()];
+    _chainLength = 0;
+    _occupied[playerRed] = new Bitboard(getLength(), _stride + 1);
+    _occupied[playerBlack] = new Bitboard(getLength(), _stride + 1);
+    _free = new Bitboard(getLength(), _stride + 1);
+    _freeCount = width * height;
+    _near[playerRed] = new Bitboard(getLength(), _stride + 1);
+    _near[playerBlack] = new Bitboard(getLength(), _stride + 1);
+    _nearValid[playerRed] = true;
+    _nearValid[playerBlack] = true;
+    _tilesCount = _free->getWords() / activeTileWords;
+    _activeTiles.assign((_tilesCount + 63) / 64, 0);
+    _neighbourMasks[playerRed] = new uint8_t[getLength()];
+    fill_n(_neighbourMasks[playerRed], getLength(), 0);
+    _neighbourMasks[playerBlack] = new uint8_t[getLength()];
+    fill_n(_neighbourMasks[playerBlack], getLength(), 0);
+    initNeighbourOffsets();
+    _groupParent = new int[getLength()];
+    for (int pos = 0; pos < getLength(); pos++)
+      _groupParent[pos] = pos;
+    _groupRank = new uint8_t[getLength()];
+    fill_n(_groupRank, getLength(), 0);
+    _emptyBaseChains = nullptr;
+    for (int pos = minPos(); pos <= maxPos(); pos++)
+      if (toX(pos) >= 0 && toX(pos) < width)
+        _free->set(pos);
     for (int x = -1; x <= width; x++)
     {
       setBad(toPos(x, -1));
@@ -533,43 +965,124 @@ public:
       setBad(toPos(width, y));
     }
     _changes.reserve(getLength());
+    _journal.reserve(getLength() * 2);
+    _groupJournal.reserve(getLength());
     _pointsSeq.reserve(getLength());
     _zobrist = zobrist;
     _hash = 0;
+#if ZOBRIST_LOCK
+    _hashLock = 0;
+#endif
+    _symmetriesCount = 0;
+    _symmetryMovesBegin = 0;
+    setSurroundCondition(surCond);
     placeBeginPattern(begin_pattern);
   }
-  Field(const Field &orig)
+  Field(const Field &orig) : Field(orig, FIELD_COPY_FULL) { }
+  // Копия поля. Снимок (FIELD_COPY_SNAPSHOT) не содержит истории ходов и копируется за O(размер поля),
+  // поэтому подходит для потоков поиска, которые не откатывают ходы дальше корня.
+  Field(const Field &orig, const FieldCopy copy)
   {
     _width = orig._width;
     _height = orig._height;
+    _stride = orig._stride;
+    _coordinates = orig._coordinates;
+    _posX = orig._posX;
+    _posY = orig._posY;
     _player = orig._player;
     _captureCount[playerRed] = orig._captureCount[playerRed];
     _captureCount[playerBlack] = orig._captureCount[playerBlack];
-    _points = new int[getLength()];
+    _points = new PointState[getLength()];
     copy_n(orig._points, getLength(), _points);
+    _waveQueue = new int[getLength()];
+    _marks = new VisitMarks(getLength());
+    _chain = new int[getLength()];
+    _chainLength = 0;
+    _occupied[playerRed] = new Bitboard(*orig._occupied[playerRed]);
+    _occupied[playerBlack] = new Bitboard(*orig._occupied[playerBlack]);
+    _free = new Bitboard(*orig._free);
+    _freeCount = orig._freeCount;
+    _near[playerRed] = new Bitboard(*orig._near[playerRed]);
+    _near[playerBlack] = new Bitboard(*orig._near[playerBlack]);
+    _nearValid[playerRed] = orig._nearValid[playerRed];
+    _nearValid[playerBlack] = orig._nearValid[playerBlack];
+    _tilesCount = orig._tilesCount;
+    _activeTiles = orig._activeTiles;
+    _neighbourMasks[playerRed] = new uint8_t[getLength()];
+    copy_n(orig._neighbourMasks[playerRed], getLength(), _neighbourMasks[playerRed]);
+    _neighbourMasks[playerBlack] = new uint8_t[getLength()];
+    copy_n(orig._neighbourMasks[playerBlack], getLength(), _neighbourMasks[playerBlack]);
+    initNeighbourOffsets();
+    _groupParent = new int[getLength()];
+    copy_n(orig._groupParent, getLength(), _groupParent);
+    _groupRank = new uint8_t[getLength()];
+    copy_n(orig._groupRank, getLength(), _groupRank);
+    _emptyBaseChains = nullptr;
+    if (copy == FIELD_COPY_FULL && orig._emptyBaseChains != nullptr)
+    {
+      _emptyBaseChains = new int[getLength()];
+      copy_n(orig._emptyBaseChains, getLength(), _emptyBaseChains);
+    }
     _changes.reserve(getLength());
     _pointsSeq.reserve(getLength());
-    _changes.assign(orig._changes.begin(), orig._changes.end());
-    _pointsSeq.assign(orig._pointsSeq.begin(), orig._pointsSeq.end());
+    if (copy == FIELD_COPY_FULL)
+    {
+      _journal.reserve(max(getLength() * 2, static_cast<int>(orig._journal.size())));
+      _changes.assign(orig._changes.begin(), orig._changes.end());
+      _journal.assign(orig._journal.begin(), orig._journal.end());
+      _groupJournal.reserve(max(getLength(), static_cast<int>(orig._groupJournal.size())));
+      _groupJournal.assign(orig._groupJournal.begin(), orig._groupJournal.end());
+      _pointsSeq.assign(orig._pointsSeq.begin(), orig._pointsSeq.end());
+      _activeJournal.assign(orig._activeJournal.begin(), orig._activeJournal.end());
+    }
+    else
+    {
+      _journal.reserve(getLength() * 2);
+      _groupJournal.reserve(getLength());
+    }
+    _surCond = orig._surCond;
+    _applyClosure = orig._applyClosure;
+    _countClosure = orig._countClosure;
     _zobrist = orig._zobrist;
     _hash = orig._hash;
+#if ZOBRIST_LOCK
+    _hashLock = orig._hashLock;
+#endif
+    _symmetriesCount = orig._symmetriesCount;
+    for (int i = 1; i < _symmetriesCount; i++)
+    {
+      _symmetryPos[i] = new int[getLength()];
+      copy_n(orig._symmetryPos[i], getLength(), _symmetryPos[i]);
+      _symmetryHashes[i] = orig._symmetryHashes[i];
+    }
+    if (copy == FIELD_COPY_FULL)
+    {
+      _symmetryHashesHistory.assign(orig._symmetryHashesHistory.begin(), orig._symmetryHashesHistory.end());
+      _symmetryMovesBegin = orig._symmetryMovesBegin;
+    }
+    else
+    {
+      _symmetryMovesBegin = 0;
+    }
   }
   ~Field()
   {
-    delete _points;
-  }
-
-  /* Set state functions */
-
-  // Установить бит TagBit.
-  void setTag(const int pos)
-  {
-    _points[pos] |= tagBit;
-  }
-  // Убрать бит TagBit.
-  void clearTag(const int pos)
-  {
-    _points[pos] &= ~tagBit;
+    delete[] _points;
+    delete[] _waveQueue;
+    delete _marks;
+    delete[] _chain;
+    delete _occupied[playerRed];
+    delete _occupied[playerBlack];
+    delete _free;
+    delete _near[playerRed];
+    delete _near[playerBlack];
+    delete[] _neighbourMasks[playerRed];
+    delete[] _neighbourMasks[playerBlack];
+    delete[] _groupParent;
+    delete[] _groupRank;
+    delete[] _emptyBaseChains;
+    for (int i = 1; i < _symmetriesCount; i++)
+      delete[] _symmetryPos[i];
   }
 
   /* Get state functions */
@@ -599,11 +1112,6 @@ public:
   {
     return (_points[pos] & emptyBaseBit) != 0;
   }
-  // Проверить по координате, помечено ли поле.
-  bool isTagged(const int pos) const
-  {
-    return (_points[pos] & tagBit) != 0;
-  }
   // Проверка незанятости поля по условию.
   bool isEnable(const int pos, const int enableCond) const
   {
@@ -665,10 +1173,79 @@ public:
   {
     return _player;
   }
+  SurroundCondition getSurroundCondition() const
+  {
+    return _surCond;
+  }
   int64_t getHash() const
   {
     return _hash;
   }
+  // Замок хеша для проверки совпадения хешей (0, если ZOBRIST_LOCK выключен).
+  int64_t getHashLock() const
+  {
+#if ZOBRIST_LOCK
+    return _hashLock;
+#else
+    return 0;
+#endif
+  }
+  // Symmetry is encoded by bits: 1 - mirror x, 2 - mirror y, 4 - then swap x and y (only on square board).
+  // Симметрия кодируется битами: 1 - отражение по x, 2 - отражение по y, 4 - затем перестановка x и y (только на квадратной доске).
+  int transformPos(const int pos, const int symmetry) const
+  {
+    int x = toX(pos), y = toY(pos);
+    if ((symmetry & 1) != 0)
+      x = _width - 1 - x;
+    if ((symmetry & 2) != 0)
+      y = _height - 1 - y;
+    if ((symmetry & 4) != 0)
+      swap(x, y);
+    return toPos(x, y);
+  }
+  // Возвращает симметрию, обратную symmetry.
+  static int inverseSymmetry(const int symmetry)
+  {
+    if ((symmetry & 4) == 0)
+      return symmetry;
+    return 4 | ((symmetry & 1) << 1) | ((symmetry & 2) >> 1);
+  }
+  // Включает инкрементальное вычисление хешей всех симметричных отображений позиции.
+  // Только по явному запросу: ни кэши, ни таблицы транспозиций канонические хеши пока не используют, перебор работает с getHash().
+  void enableSymmetryHashes()
+  {
+    if (_symmetriesCount != 0)
+      return;
+    _symmetriesCount = _width == _height ? 8 : 4;
+    for (int i = 1; i < _symmetriesCount; i++)
+    {
+      _symmetryPos[i] = new int[getLength()];
+      for (int pos = 0; pos < getLength(); pos++)
+        _symmetryPos[i][pos] = (_points[pos] & badBit) != 0 ? pos : transformPos(pos, i);
+    }
+    _symmetryHashesHistory.reserve(getLength() * (_symmetriesCount - 1));
+    recomputeSymmetryHashes();
+  }
+  // Количество симметричных отображений позиции, хеши которых вычисляются (1, если не включено).
+  int getSymmetriesCount() const
+  {
+    return max(_symmetriesCount, 1);
+  }
+  // Хеш позиции, отображённой симметрией symmetry.
+  int64_t getSymmetryHash(const int symmetry) const
+  {
+    return symmetry == 0 ? _hash : _symmetryHashes[symmetry];
+  }
+  // Канонический хеш - минимальный из хешей симметричных отображений позиции.
+  // В symmetry записывается симметрия, переводящая позицию в каноническую (при равенстве хешей - с меньшим номером).
+  int64_t getCanonicalHash(int& symmetry) const
+  {
+    symmetry = 0;
+    for (int i = 1; i < _symmetriesCount; i++)
+      if (_symmetryHashes[i] < getSymmetryHash(symmetry))
+        symmetry = i;
+    return getSymmetryHash(symmetry);
+  }
   int getWidth() const
   {
     return _width;
@@ -679,7 +1256,7 @@ public:
   }
   int getLength() const
   {
-    return (_width + 2) * (_height + 2);
+    return _stride * (_height + 2);
   }
   Zobrist& getZobrist() const
   {
@@ -698,11 +1275,11 @@ public:
 
   int n(const int pos) const
   {
-    return pos - (_width + 2);
+    return pos - _stride;
   }
   int s(const int pos) const
   {
-    return pos + (_width + 2);
+    return pos + _stride;
   }
   int w(const int pos) const
   {
@@ -714,31 +1291,31 @@ public:
   }
   int nw(const int pos) const
   {
-    return pos - (_width + 2) - 1;
+    return pos - _stride - 1;
   }
   int ne(const int pos) const
   {
-    return pos - (_width + 2) + 1;
+    return pos - _stride + 1;
   }
   int sw(const int pos) const
   {
-    return pos + (_width + 2) - 1;
+    return pos + _stride - 1;
   }
   int se(const int pos) const
   {
-    return pos + (_width + 2) + 1;
+    return pos + _stride + 1;
   }
   int toPos(const int x, const int y) const
   {
-    return (y + 1) * (_width + 2) + x + 1;
+    return (y + 1) * _stride + x + 1;
   }
   int toX(const int pos) const
   {
-    return pos % (_width + 2) - 1;
+    return _posX[pos];
   }
   int toY(const int pos) const
   {
-    return pos / (_width + 2) - 1;
+    return _posY[pos];
   }
   // Конвертация из Pos в XY.
   void toXY(const int pos, int &x, int &y) const
@@ -772,64 +1349,98 @@ public:
     else
       return false;
   }
+  // Маска соседей centerPos, которые являются незахваченными точками игрока player (см. NeighbourDirection).
+  uint8_t getNeighbourMask(const int centerPos, const int player) const
+  {
+    return _neighbourMasks[player][centerPos];
+  }
   // Проверяет, есть ли рядом с centerPos точки цвета player.
   bool isNearPoints(const int centerPos, const int player) const
   {
-    if (isEnable(n(centerPos), putBit | player)  ||
-        isEnable(s(centerPos), putBit | player)  ||
-        isEnable(w(centerPos), putBit | player)  ||
-        isEnable(e(centerPos), putBit | player)  ||
-        isEnable(nw(centerPos), putBit | player) ||
-        isEnable(ne(centerPos), putBit | player) ||
-        isEnable(sw(centerPos), putBit | player) ||
-        isEnable(se(centerPos), putBit | player))
-      return true;
-    else
-      return false;
+    return _neighbourMasks[player][centerPos] != 0;
   }
   // Возвращает количество точек рядом с centerPos цвета player.
   int numberNearPoints(const int centerPos, const int player) const
   {
-    int result = 0;
-    if (isEnable(n(centerPos), putBit | player))
-      result++;
-    if (isEnable(s(centerPos), putBit | player))
-      result++;
-    if (isEnable(w(centerPos), putBit | player))
-      result++;
-    if (isEnable(e(centerPos), putBit | player))
-      result++;
-    if (isEnable(nw(centerPos), putBit | player))
-      result++;
-    if (isEnable(ne(centerPos), putBit | player))
-      result++;
-    if (isEnable(sw(centerPos), putBit | player))
-      result++;
-    if (isEnable(se(centerPos), putBit | player))
-      result++;
-    return result;
+    return neighbourhoodTables.points[_neighbourMasks[player][centerPos]];
   }
   // Возвращает количество групп точек рядом с centerPos.
   int numberNearGroups(const int centerPos, const int player) const
   {
-    int result = 0;
-    if (isNotEnable(w(centerPos), player | putBit) && (isEnable(nw(centerPos), player | putBit) || isEnable(n(centerPos), player | putBit)))
-      result++;
-    if (isNotEnable(s(centerPos), player | putBit) && (isEnable(sw(centerPos), player | putBit) || isEnable(w(centerPos), player | putBit)))
-      result++;
-    if (isNotEnable(e(centerPos), player | putBit) && (isEnable(se(centerPos), player | putBit) || isEnable(s(centerPos), player | putBit)))
-      result++;
-    if (isNotEnable(n(centerPos), player | putBit) && (isEnable(ne(centerPos), player | putBit) || isEnable(e(centerPos), player | putBit)))
-      result++;
-    return result;
+    return neighbourhoodTables.groups[_neighbourMasks[player][centerPos]];
+  }
+  // Битборд незахваченных точек игрока player.
+  const Bitboard& getOccupied(const int player) const
+  {
+    return *_occupied[player];
+  }
+  // Битборд полей, в которые можно поставить точку.
+  const Bitboard& getFree() const
+  {
+    return *_free;
+  }
+  // Битборд полей рядом с незахваченными точками игрока player.
+  const Bitboard& getNear(const int player)
+  {
+    if (!_nearValid[player])
+    {
+      for (int begin = 0, end = 0; nextActiveRun(end, begin, end); )
+        bitboardNearMask(*_occupied[player], _stride, *_near[player], begin, end);
+      _nearValid[player] = true;
+    }
+    return *_near[player];
   }
-  bool isPointInsideRing(const int pos, const list<int> &ring) const
+  // Находит первую серию подряд идущих активных плиток, начинающуюся не раньше слова from (кратного activeTileWords),
+  // и записывает её слова битбордов в [begin, end). Возвращает false, если таких плиток нет (см. _activeTiles).
+  // Обход всех серий: for (int begin = 0, end = 0; field.nextActiveRun(end, begin, end); ).
+  bool nextActiveRun(const int from, int& begin, int& end) const
   {
+    int tile = findTile(from / activeTileWords, true);
+    if (tile == _tilesCount)
+      return false;
+    begin = tile * activeTileWords;
+    end = findTile(tile + 1, false) * activeTileWords;
+    return true;
+  }
+  // Записывает в result свободные поля рядом с незахваченными точками игрока player (ходы-кандидаты).
+  // result должен иметь размер getLength(), вне активных плиток он не изменяется и должен быть пустым.
+  // Обход result.range(begin, end) по сериям nextActiveRun даёт поля в порядке возрастания координаты.
+  void getCandidates(const int player, Bitboard& result)
+  {
+    const Bitboard& near = getNear(player);
+    for (int begin = 0, end = 0; nextActiveRun(end, begin, end); )
+      result.assignAnd(near, *_free, begin, end);
+  }
+  // Проверяет, заполнено ли поле (нет ни одного поля, куда можно поставить точку).
+  bool isFull() const
+  {
+    return _freeCount == 0;
+  }
+  // Помечает в result поля, рядом с которыми есть точки игрока player (isNearPoints для всей доски).
+  // result должен иметь размер getLength() и допускать сдвиг на getWidth() + 3.
+  void getNearPointsMask(const int player, Bitboard& result) const
+  {
+    bitboardNearMask(*_occupied[player], _stride, result);
+  }
+  // Записывает в counts количество точек игрока player рядом с каждым полем (numberNearPoints для всей доски).
+  void getNearPointsCounts(const int player, uint8_t* counts) const
+  {
+    bitboardNearCounts(*_occupied[player], _stride, counts);
+  }
+  // Записывает в counts количество групп точек игрока player рядом с каждым полем (numberNearGroups для всей доски).
+  void getNearGroupsCounts(const int player, uint8_t* counts) const
+  {
+    bitboardNearGroups(*_occupied[player], _stride, counts);
+  }
+  bool isPointInsideRing(const int pos, const int* ring, const int ringLength) const
+  {
+    Point a;
+    toXY(pos, a.x, a.y);
     int intersections = 0;
     IntersectionState state = INTERSECTION_STATE_NONE;
-    for (auto i = ring.begin(); i != ring.end(); i++)
+    for (int i = 0; i < ringLength; i++)
     {
-      switch (getIntersectionState(pos, *i))
+      switch (getIntersectionState(a, ring[i]))
       {
       case (INTERSECTION_STATE_NONE):
         state = INTERSECTION_STATE_NONE;
@@ -850,12 +1461,12 @@ public:
     }
     if (state == INTERSECTION_STATE_UP || state == INTERSECTION_STATE_DOWN)
     {
-      auto i = ring.begin();
-      IntersectionState beginState = getIntersectionState(pos, *i);
+      int i = 0;
+      IntersectionState beginState = getIntersectionState(a, ring[i]);
       while (beginState == INTERSECTION_STATE_TARGET)
       {
         i++;
-        beginState = getIntersectionState(pos, *i);
+        beginState = getIntersectionState(a, ring[i]);
       }
       if ((state == INTERSECTION_STATE_UP && beginState == INTERSECTION_STATE_DOWN) ||
           (state == INTERSECTION_STATE_DOWN && beginState == INTERSECTION_STATE_UP))
@@ -863,45 +1474,78 @@ public:
     }
     return intersections % 2 == 1;
   }
-  void wave(const int startPos, const function<bool(int)>& cond)
+  // Строит цепочку из незахваченных точек игрока player от startPos в направлении directionPos.
+  // Возвращает true, если цепочка является окружением.
+  bool buildPlayerChain(const int startPos, const int player, const int directionPos)
+  {
+    return buildChain(startPos, player | putBit, directionPos);
+  }
+  // Проверяет, лежит ли точка внутри последней построенной цепочки.
+  // Точки вне ограничивающего прямоугольника цепочки отбрасываются сразу.
+  bool isPointInsideChain(const int pos) const
+  {
+    int x, y;
+    toXY(pos, x, y);
+    if (x <= _chainMinX || x >= _chainMaxX || y <= _chainMinY || y >= _chainMaxY)
+      return false;
+    return isPointInsideRing(pos, _chain, _chainLength);
+  }
+  // Обход в ширину от startPos по полям, удовлетворяющим условию cond.
+  // Каждое поле, удовлетворяющее условию, попадает в очередь не более одного раза.
+  // Отвергнутые поля не помечаются и могут проверяться условием повторно от каждого соседа.
+  // Возвращает количество пройденных полей, которые остаются в начале очереди до следующего обхода.
+  template<typename Cond>
+  int wave(const int startPos, const Cond& cond)
+  {
+    _marks->clear();
+    return waveMarked(startPos, cond, *_marks, _waveQueue);
+  }
+  // Тот же обход с пометками и очередью вызывающего, поле не изменяется.
+  // Потоки с собственными marks и queue могут одновременно обходить одно поле.
+  template<typename Cond>
+  int wave(const int startPos, const Cond& cond, VisitMarks& marks, int* queue) const
+  {
+    marks.clear();
+    return waveMarked(startPos, cond, marks, queue);
+  }
+  // Обход, который не заходит на уже помеченные в marks поля.
+  template<typename Cond>
+  int waveMarked(const int startPos, const Cond& cond, VisitMarks& marks, int* queue) const
   {
-    // Очередь для волнового алгоритма (обхода в ширину).
-    list<int> q;
     if (!cond(startPos))
-      return;
-    q.push_back(startPos);
-    setTag(startPos);
-    auto it = q.begin();
-    while (it != q.end())
+      return 0;
+    int head = 0, tail = 0;
+    queue[tail++] = startPos;
+    marks.set(startPos);
+    while (head != tail)
     {
-      int wPos = w(*it);
-      if (!isTagged(wPos) && cond(wPos))
+      int pos = queue[head++];
+      int wPos = w(pos);
+      if (!marks.test(wPos) && cond(wPos))
       {
-        q.push_back(wPos);
-        setTag(wPos);
+        queue[tail++] = wPos;
+        marks.set(wPos);
       }
-      int nPos = n(*it);
-      if (!isTagged(nPos) && cond(nPos))
+      int nPos = n(pos);
+      if (!marks.test(nPos) && cond(nPos))
       {
-        q.push_back(nPos);
-        setTag(nPos);
+        queue[tail++] = nPos;
+        marks.set(nPos);
       }
-      int ePos = e(*it);
-      if (!isTagged(ePos) && cond(ePos))
+      int ePos = e(pos);
+      if (!marks.test(ePos) && cond(ePos))
       {
-        q.push_back(ePos);
-        setTag(ePos);
+        queue[tail++] = ePos;
+        marks.set(ePos);
       }
-      int sPos = s(*it);
-      if (!isTagged(sPos) && cond(sPos))
+      int sPos = s(pos);
+      if (!marks.test(sPos) && cond(sPos))
       {
-        q.push_back(sPos);
-        setTag(sPos);
+        queue[tail++] = sPos;
+        marks.set(sPos);
       }
-      it++;
     }
-    for (it = q.begin(); it != q.end(); it++)
-      clearTag(*it);
+    return tail;
   }
   void setPlayer(const int player)
   {
@@ -939,30 +1583,166 @@ public:
   }
   void doUnsafeStep(const int pos, const int player)
   {
-    _changes.emplace_back(_captureCount[0], _captureCount[1], _player, _hash);
-    _changes.back().changes.emplace(pos, _points[pos]);
+    _changes.emplace_back(_captureCount[0], _captureCount[1], _player, _hash, _journal.size(), _groupJournal.size());
+#if ZOBRIST_LOCK
+    _changes.back().lock = _hashLock;
+#endif
+    _changes.back().activeJournalBegin = static_cast<int>(_activeJournal.size());
+    if (_symmetriesCount != 0)
+      _symmetryHashesHistory.insert(_symmetryHashesHistory.end(), _symmetryHashes + 1, _symmetryHashes + _symmetriesCount);
+    _journal.emplace_back(pos, _points[pos]);
     _pointsSeq.push_back(pos);
     // Добавляем в изменения поставленную точку.
     setPlayerPutted(pos, player);
+    updateBitboards(pos, _journal.back().second);
     updateHash(pos, player);
-    checkClosure(pos, player);
+    (this->*_applyClosure)(pos, player);
+    addToGroups(pos, player);
     setPlayer(nextPlayer(player));
   }
+  // Предсказывает изменение счета игрока player (getDeltaScore(player)) после хода в pos, не делая его.
+  // Положительное значение - ход окружает точки противника, отрицательное - поставленная точка сама будет окружена,
+  // что возможно только при ходе в пустую базу противника.
+  // Поле, журнал, хеш и битборды остаются неизменными.
+  int getCaptureDelta(const int pos, const int player)
+  {
+    PointState oldState = _points[pos];
+    setPlayerPutted(pos, player);
+    int result = (this->*_countClosure)(pos, player);
+    _points[pos] = oldState;
+    return result;
+  }
+  // Необходимое условие того, что ход игрока player в pos вне пустой базы окружит точки противника:
+  // рядом с pos не меньше двух групп точек игрока, и какие-то две из них уже соединены.
+  // Проверяется до хода, так как ни сама точка pos, ни её объединение с группами на это не влияют.
+  bool maySurround(const int pos, const int player) const
+  {
+    int inpChainPoints[4], inpSurPoints[4];
+    int inpPointsCount = getInputPoints(pos, player | putBit, inpChainPoints, inpSurPoints);
+    return inpPointsCount > 1 && hasConnectedGroups(inpChainPoints, inpPointsCount);
+  }
   // Откат хода.
   void undoStep()
   {
     _pointsSeq.pop_back();
     BoardChange& change = _changes.back();
-    while (!change.changes.empty())
+    if (static_cast<int>(_journal.size()) - change.journalBegin == 1)
     {
-      pair<int, int>& top = change.changes.top();
-      _points[top.first] = top.second;
-      change.changes.pop();
+      int pos = _journal.back().first;
+      PointState oldState = _points[pos];
+      _points[pos] = _journal.back().second;
+      updateBitboards(pos, oldState);
     }
+    else
+    {
+      int firstPos = getLength(), lastPos = 0;
+      for (int i = static_cast<int>(_journal.size()) - 1; i >= change.journalBegin; i--)
+      {
+        int pos = _journal[i].first;
+        _points[pos] = _journal[i].second;
+        firstPos = min(firstPos, pos);
+        lastPos = max(lastPos, pos);
+      }
+      rebuildBitboards(firstPos, lastPos);
+    }
+    _journal.resize(change.journalBegin);
+    rollbackGroups(change.groupJournalBegin);
+    restoreActive(change.activeJournalBegin);
     _captureCount[0] = change.captureCount[0];
     _captureCount[1] = change.captureCount[1];
     _player = change.player;
     _hash = change.hash;
+#if ZOBRIST_LOCK
+    _hashLock = change.lock;
+#endif
     _changes.pop_back();
+    if (_symmetriesCount != 0)
+    {
+      if (getMovesCount() >= _symmetryMovesBegin)
+      {
+        int begin = static_cast<int>(_symmetryHashesHistory.size()) - (_symmetriesCount - 1);
+        copy_n(_symmetryHashesHistory.begin() + begin, _symmetriesCount - 1, _symmetryHashes + 1);
+        _symmetryHashesHistory.resize(begin);
+      }
+      else
+      {
+        recomputeSymmetryHashes();
+      }
+    }
+  }
+  // Запоминает текущую позицию в checkpoint.
+  void makeCheckpoint(FieldCheckpoint& checkpoint) const
+  {
+    checkpoint.points.clear();
+    for (int begin = 0, end = 0; nextActiveRun(end, begin, end); )
+      checkpoint.points.insert(checkpoint.points.end(), _points + begin * 64, _points + min(end * 64, getLength()));
+    checkpoint.movesCount = getMovesCount();
+    checkpoint.journalSize = static_cast<int>(_journal.size());
+    checkpoint.groupJournalSize = static_cast<int>(_groupJournal.size());
+    checkpoint.activeJournalSize = static_cast<int>(_activeJournal.size());
+    checkpoint.captureCount[0] = _captureCount[0];
+    checkpoint.captureCount[1] = _captureCount[1];
+    checkpoint.player = _player;
+    checkpoint.hash = _hash;
+#if ZOBRIST_LOCK
+    checkpoint.lock = _hashLock;
+#endif
+    checkpoint.symmetriesCount = _symmetriesCount;
+    copy_n(_symmetryHashes, _symmetriesCount, checkpoint.symmetryHashes);
+    checkpoint.symmetryHashesHistorySize = static_cast<int>(_symmetryHashesHistory.size());
+  }
+  // Возвращает поле к позиции checkpoint, запомненной на этом поле, если с тех пор ходы не откатывались за неё.
+  // Если после неё изменилось мало точек, то ходы откатываются по журналу, иначе состояния точек активных плиток копируются.
+  void restoreCheckpoint(const FieldCheckpoint& checkpoint)
+  {
+    if ((static_cast<int>(_journal.size()) - checkpoint.journalSize) * checkpointReplayCost < getLength())
+    {
+      while (getMovesCount() > checkpoint.movesCount)
+        undoStep();
+      return;
+    }
+    // Плитки, ставшие активными после контрольной точки, возвращаются в исходное состояние и временно исключаются,
+    // чтобы серии активных плиток совпали с сериями, запомненными в checkpoint.points.
+    for (int i = checkpoint.activeJournalSize; i < static_cast<int>(_activeJournal.size()); i++)
+    {
+      int tile = _activeJournal[i];
+      for (int pos = tile * activeTileWords * 64; pos < min((tile + 1) * activeTileWords * 64, getLength()); pos++)
+        _points[pos] = initialState(pos);
+      _activeTiles[tile >> 6] &= ~(uint64_t(1) << (tile & 63));
+    }
+    auto saved = checkpoint.points.begin();
+    for (int begin = 0, end = 0; nextActiveRun(end, begin, end); )
+    {
+      int count = min(end * 64, getLength()) - begin * 64;
+      copy_n(saved, count, _points + begin * 64);
+      saved += count;
+    }
+    for (int i = checkpoint.activeJournalSize; i < static_cast<int>(_activeJournal.size()); i++)
+      _activeTiles[_activeJournal[i] >> 6] |= uint64_t(1) << (_activeJournal[i] & 63);
+    rebuildBitboards();
+    restoreActive(checkpoint.activeJournalSize);
+    _journal.resize(checkpoint.journalSize);
+    rollbackGroups(checkpoint.groupJournalSize);
+    _changes.erase(_changes.begin() + checkpoint.movesCount, _changes.end());
+    _pointsSeq.resize(checkpoint.movesCount);
+    _captureCount[0] = checkpoint.captureCount[0];
+    _captureCount[1] = checkpoint.captureCount[1];
+    _player = checkpoint.player;
+    _hash = checkpoint.hash;
+#if ZOBRIST_LOCK
+    _hashLock = checkpoint.lock;
+#endif
+    if (_symmetriesCount != 0)
+    {
+      if (checkpoint.symmetriesCount == _symmetriesCount && checkpoint.movesCount >= _symmetryMovesBegin)
+      {
+        copy_n(checkpoint.symmetryHashes, _symmetriesCount, _symmetryHashes);
+        _symmetryHashesHistory.resize(checkpoint.symmetryHashesHistorySize);
+      }
+      else
+      {
+        recomputeSymmetryHashes();
+      }
+    }
   }
 };
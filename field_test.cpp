@@ -0,0 +1,108 @@
+#include "config.h"
+#include "basic_types.h"
+#include "field.h"
+#include "zobrist.h"
+#include <iostream>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+// Checks that incrementally maintained hashes of Field depend only on the position and not on the path to it.
+// Random games with undoes are played for every surround rule with symmetry hashes enabled from the start.
+// After every move the hash is compared with the hash computed from scratch over the board, and symmetric hashes
+// are compared with the ones recomputed by enableSymmetryHashes on a field where the same moves were replayed.
+// Symmetric hashes are opt-in (Field::enableSymmetryHashes): no cache or transposition table uses them yet.
+// Usage: opai_field_test. Prints the number of checked positions and mismatches for every rule, fails on mismatches.
+
+const char* ruleNames[] = { "standart", "always", "always_enemy" };
+
+// Hash of the position computed from scratch: every field enters the hash of the player it belongs to.
+int64_t hashFromScratch(const Field& field)
+{
+  int64_t result = 0;
+  for (int pos = field.minPos(); pos <= field.maxPos(); pos++)
+  {
+    int owner;
+    if (field.isCaptured(pos))
+      owner = field.isPutted(pos) ? nextPlayer(field.getPlayer(pos)) : field.getPlayer(pos);
+    else if (field.isPutted(pos))
+      owner = field.getPlayer(pos);
+    else
+      continue;
+    result ^= field.getZobrist().getHash((owner == 0 ? 0 : field.getLength()) + pos);
+  }
+  return result;
+}
+
+// Returns the number of mismatches in the current position of the field.
+int checkPosition(const Field& field, const SurroundCondition surCond)
+{
+  int errors = 0;
+  if (field.getHash() != hashFromScratch(field))
+    errors++;
+  Field replayed(field.getWidth(), field.getHeight(), BEGIN_PATTERN_CLEAN, &field.getZobrist(), surCond);
+  for (auto i = field.getPointsSeq().begin(); i != field.getPointsSeq().end(); i++)
+    replayed.doStep(*i, field.getPlayer(*i));
+  replayed.enableSymmetryHashes();
+  for (int i = 0; i < field.getSymmetriesCount(); i++)
+    if (field.getSymmetryHash(i) != replayed.getSymmetryHash(i))
+      errors++;
+  int symmetry, replayedSymmetry;
+  if (field.getCanonicalHash(symmetry) != replayed.getCanonicalHash(replayedSymmetry) || symmetry != replayedSymmetry)
+    errors++;
+  return errors;
+}
+
+int main()
+{
+  const int sizes[][2] = { { 10, 10 }, { 13, 9 } };
+  int totalErrors = 0;
+  for (int rule = SUR_COND_STANDART; rule <= SUR_COND_ALWAYS_ENEMY; rule++)
+  {
+    SurroundCondition surCond = static_cast<SurroundCondition>(rule);
+    long positions = 0;
+    int errors = 0;
+    for (int seed = 1; seed <= 100; seed++)
+    {
+      int width = sizes[seed % 2][0], height = sizes[seed % 2][1];
+      mt19937_64 gen(seed);
+      Zobrist zobrist(2 * (width + 2) * (height + 2), &gen);
+      Field field(width, height, BEGIN_PATTERN_CLEAN, &zobrist, surCond);
+      field.enableSymmetryHashes();
+      vector<int> moves;
+      while (true)
+      {
+        moves.clear();
+        for (int pos = field.minPos(); pos <= field.maxPos(); pos++)
+          if (field.isPuttingAllowed(pos))
+            moves.push_back(pos);
+        if (moves.empty())
+          break;
+        // Half of the points are put near the previous one, so that surroundings happen more often.
+        int pos = moves[gen() % moves.size()];
+        if (!field.getPointsSeq().empty() && gen() % 2 == 0)
+        {
+          int last = field.getPointsSeq().back();
+          for (int attempt = 0; attempt < 8; attempt++)
+          {
+            int near = field.toPos(field.toX(last) + static_cast<int>(gen() % 5) - 2, field.toY(last) + static_cast<int>(gen() % 5) - 2);
+            if (near >= field.minPos() && near <= field.maxPos() && field.isPuttingAllowed(near))
+            {
+              pos = near;
+              break;
+            }
+          }
+        }
+        field.doStep(pos);
+        if (gen() % 8 == 0)
+          field.undoStep();
+        errors += checkPosition(field, surCond);
+        positions++;
+      }
+    }
+    cout << ruleNames[rule] << ": positions " << positions << ", mismatches " << errors << endl;
+    totalErrors += errors;
+  }
+  return totalErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+// Map from 64-bit hashes to integers with open addressing and linear probing.
+// Slot is occupied if its stamp equals the current epoch, so the map is cleared in O(1).
+// Отображение 64-битных хешей в целые числа с открытой адресацией и линейным пробированием.
+// Ячейка занята, если её метка равна текущей эпохе, поэтому отображение очищается за O(1).
+class HashMap
+{
+private:
+  // Number of slots, power of two.
+  int _capacity;
+  int _count;
+  int64_t* _keys;
+  int* _values;
+  uint32_t* _stamps;
+  uint32_t _epoch;
+
+  int slot(const int64_t key) const
+  {
+    // Ключи - хеши Зобриста, поэтому достаточно перемешать старшие биты с младшими.
+    uint64_t x = static_cast<uint64_t>(key);
+    return static_cast<int>((x ^ (x >> 32)) & static_cast<uint64_t>(_capacity - 1));
+  }
+  void allocate(const int capacity)
+  {
+    _capacity = capacity;
+    _keys = new int64_t[capacity];
+    _values = new int[capacity];
+    _stamps = new uint32_t[capacity];
+    fill_n(_stamps, capacity, 0);
+    _epoch = 1;
+    _count = 0;
+  }
+  void grow()
+  {
+    int64_t* keys = _keys;
+    int* values = _values;
+    uint32_t* stamps = _stamps;
+    int capacity = _capacity;
+    uint32_t epoch = _epoch;
+    allocate(capacity * 2);
+    for (int i = 0; i < capacity; i++)
+      if (stamps[i] == epoch)
+        insert(keys[i], values[i]);
+    delete[] keys;
+    delete[] values;
+    delete[] stamps;
+  }
+
+public:
+  HashMap(const int capacity)
+  {
+    allocate(capacity);
+  }
+  HashMap(const HashMap&) = delete;
+  HashMap& operator=(const HashMap&) = delete;
+  ~HashMap()
+  {
+    delete[] _keys;
+    delete[] _values;
+    delete[] _stamps;
+  }
+  void clear()
+  {
+    _count = 0;
+    _epoch++;
+    if (_epoch == numeric_limits<uint32_t>::max())
+    {
+      fill_n(_stamps, _capacity, 0);
+      _epoch = 1;
+    }
+  }
+  // Возвращает значение для key или nullptr, если его нет.
+  int* find(const int64_t key)
+  {
+    for (int i = slot(key); _stamps[i] == _epoch; i = (i + 1) & (_capacity - 1))
+      if (_keys[i] == key)
+        return &_values[i];
+    return nullptr;
+  }
+  // Добавляет key со значением value. Возвращает false, если key уже был, его значение при этом не меняется.
+  bool insert(const int64_t key, const int value)
+  {
+    if ((_count + 1) * 2 > _capacity)
+      grow();
+    for (int i = slot(key); ; i = (i + 1) & (_capacity - 1))
+    {
+      if (_stamps[i] != _epoch)
+      {
+        _stamps[i] = _epoch;
+        _keys[i] = key;
+        _values[i] = value;
+        _count++;
+        return true;
+      }
+      if (_keys[i] == key)
+        return false;
+    }
+  }
+};
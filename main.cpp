@@ -5,6 +5,7 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <cctype>
 
 Bot *bot;
 
@@ -74,11 +75,22 @@ void init(int id)
 {
   int x, y;
   int64_t seed;
+  int rule = SUR_COND;
   cin >> x >> y >> seed;
+  // Необязательный последний параметр - правило обработки пустых баз.
+  while (cin.peek() == ' ' || cin.peek() == '\t')
+    cin.get();
+  if (isdigit(cin.peek()))
+    cin >> rule;
+  if (rule < SUR_COND_STANDART || rule > SUR_COND_ALWAYS_ENEMY)
+  {
+    cout << "?" << " " << id << " " << "init" << endl;
+    return;
+  }
   // Если существовало поле - удаляем его.
   if (bot != NULL)
     delete bot;
-  bot = new Bot(x, y, BEGIN_PATTERN_CLEAN, seed);
+  bot = new Bot(x, y, BEGIN_PATTERN_CLEAN, static_cast<SurroundCondition>(rule), seed);
   cout << "=" << " " << id << " " << "init" << endl;
 }
 
@@ -16,24 +16,19 @@ using namespace std;
 // Pos - последний выбранный, но не сделанный ход.
 // alpha, beta - интервал оценок, вне которого искать нет смысла.
 // На выходе оценка позиции для CurPlayer (до хода Pos).
-int alphabeta(Field* field, int depth, int pos, Trajectories* last, int alpha, int beta, int* emptyBoard)
+int alphabeta(Field* field, int depth, int pos, Trajectories* last, int alpha, int beta, TrajectoriesArena* arena)
 {
-  Trajectories curTrajectories(field, emptyBoard);
-  // Делаем ход, выбранный на предыдущем уровне рекурсии, после чего этот ход становится вражеским.
-  field->doUnsafeStep(pos);
+  // На последнем уровне достаточно знать, как ход изменит счет, делать его не нужно.
   if (depth == 0)
-  {
-    int bestEstimate = field->getScore(field->getPlayer());
-    field->undoStep();
-    return -bestEstimate;
-  }
-  if (field->getDeltaScore() < 0) // Если точка поставлена в окружение.
-  {
-    field->undoStep();
+    return field->getScore(field->getPlayer()) + field->getCaptureDelta(pos, field->getPlayer());
+  // Точка может быть окружена, только если поставлена в пустую базу противника.
+  if (field->isInEmptyBase(pos) && field->getCaptureDelta(pos, field->getPlayer()) < 0) // Если точка поставлена в окружение.
     return -numeric_limits<int>::max(); // Для CurPlayer это хорошо, то есть оценка Infinity.
-  }
+  Trajectories curTrajectories(field, arena);
+  // Делаем ход, выбранный на предыдущем уровне рекурсии, после чего этот ход становится вражеским.
+  field->doUnsafeStep(pos);
   curTrajectories.buildTrajectories(last, pos);
-  const list<int>* moves = curTrajectories.getPoints();
+  const ArenaSpan<int>* moves = curTrajectories.getPoints();
   if (moves->empty())
   {
     int bestEstimate = field->getScore(field->getPlayer());
@@ -42,9 +37,9 @@ int alphabeta(Field* field, int depth, int pos, Trajectories* last, int alpha, i
   }
   for (auto i = moves->begin(); i != moves->end(); i++)
   {
-    int curEstimate = alphabeta(field, depth - 1, *i, &curTrajectories, -alpha - 1, -alpha, emptyBoard);
+    int curEstimate = alphabeta(field, depth - 1, *i, &curTrajectories, -alpha - 1, -alpha, arena);
     if (curEstimate > alpha && curEstimate < beta)
-      curEstimate = alphabeta(field, depth - 1, *i, &curTrajectories, -beta, -curEstimate, emptyBoard);
+      curEstimate = alphabeta(field, depth - 1, *i, &curTrajectories, -beta, -curEstimate, arena);
     if (curEstimate > alpha)
     {
       alpha = curEstimate;
@@ -56,9 +51,9 @@ int alphabeta(Field* field, int depth, int pos, Trajectories* last, int alpha, i
   return -alpha;
 }
 
-int getEnemyEstimate(Field** fields, int** emptyBoards, int maxThreads, Trajectories* last, int depth)
+int getEnemyEstimate(Field** fields, TrajectoriesArena** arenas, int maxThreads, Trajectories* last, int depth)
 {
-  Trajectories curTrajectories(fields[0], emptyBoards[0]);
+  Trajectories curTrajectories(fields[0], arenas[0]);
   int result;
   vector<int> moves;
   for (int i = 0; i < maxThreads; i++)
@@ -81,9 +76,9 @@ int getEnemyEstimate(Field** fields, int** emptyBoards, int maxThreads, Trajecto
       {
         if (alpha < beta)
         {
-          int curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -alpha - 1, -alpha, emptyBoards[threadNum]);
+          int curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -alpha - 1, -alpha, arenas[threadNum]);
           if (curEstimate > alpha && curEstimate < beta)
-            curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -beta, -curEstimate, emptyBoards[threadNum]);
+            curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -beta, -curEstimate, arenas[threadNum]);
           #pragma omp critical
           {
             if (curEstimate > alpha) // Обновляем нижнюю границу.
@@ -99,6 +94,57 @@ int getEnemyEstimate(Field** fields, int** emptyBoards, int maxThreads, Trajecto
   return -result;
 }
 
+// Строит траектории корня поиска trajectories на глубину depth параллельно.
+// Ветки траекторий каждого игрока по первому ходу строятся на полях и аренах потоков fields и arenas,
+// а затем объединяются в порядке первых ходов, поэтому результат совпадает с последовательным buildTrajectories.
+void buildRootTrajectories(Trajectories* trajectories, Field** fields, TrajectoriesArena** arenas, int depth)
+{
+  const int players[] = { trajectories->getCurPlayer(), trajectories->getEnemyPlayer() };
+  trajectories->setDepth(depth);
+  // Ветки - пары из игрока и первого хода.
+  vector<pair<int, int>> branches;
+  vector<int> firstMoves;
+  for (int player : players)
+  {
+    trajectories->getFirstMoves(player, &firstMoves);
+    for (auto i = firstMoves.begin(); i != firstMoves.end(); i++)
+      branches.emplace_back(player, *i);
+  }
+  vector<vector<Trajectory>> results(branches.size());
+  #pragma omp parallel
+  {
+    int threadNum = omp_get_thread_num();
+    #pragma omp for schedule(dynamic, 1)
+    for (int i = 0; i < static_cast<int>(branches.size()); i++)
+    {
+      Trajectories branch(fields[threadNum], arenas[threadNum]);
+      branch.setDepth(depth);
+      branch.buildPlayerTrajectories(branches[i].first, branches[i].second);
+      const ArenaSpan<Trajectory>* branchTrajectories = branch.getTrajectories(branches[i].first);
+      results[i].assign(branchTrajectories->begin(), branchTrajectories->end());
+    }
+  }
+  for (int player : players)
+  {
+    trajectories->beginTrajectories(player);
+    for (size_t i = 0; i < branches.size(); i++)
+      if (branches[i].first == player)
+        trajectories->mergeTrajectories(results[i].data(), results[i].data() + results[i].size(), player);
+  }
+  trajectories->calculateMoves();
+}
+
+// Удаляет поля и арены потоков, кроме первых, принадлежащих вызывающему.
+void deleteThreadsData(Field** fields, TrajectoriesArena** arenas, int maxThreads)
+{
+  for (int i = 1; i < maxThreads; i++)
+    delete arenas[i];
+  delete[] arenas;
+  for (int i = 1; i < maxThreads; i++)
+    delete fields[i];
+  delete[] fields;
+}
+
 // CurField - поле, на котором производится оценка.
 // Depth - глубина оценки.
 // Moves - на входе возможные ходы, на выходе лучшие из них.
@@ -106,35 +152,33 @@ int minimax(Field* field, int depth)
 {
   if (depth <= 0)
     return -1;
-  int* emptyBoard = new int[field->getLength()];
-  fill_n(emptyBoard, field->getLength(), 0);
+  // Глубина ограничена, чтобы точки траекторий помещались в Trajectory.
+  depth = min(depth, maxTrajectoryDepth);
+  TrajectoriesArena arena(field->getLength(), field->getWidth());
+  int maxThreads = omp_get_max_threads();
+  TrajectoriesArena** arenas = new TrajectoriesArena*[maxThreads];
+  arenas[0] = &arena;
+  for (auto i = 1; i < maxThreads; i++)
+    arenas[i] = new TrajectoriesArena(field->getLength(), field->getWidth());
+  Field** fields = new Field*[maxThreads];
+  fields[0] = field;
+  for (int i = 1; i < maxThreads; i++)
+    fields[i] = new Field(*field, FIELD_COPY_SNAPSHOT);
   // Главные траектории - свои и вражеские.
-  Trajectories curTrajectories(field, emptyBoard);
-  int result;
+  Trajectories curTrajectories(field, &arena);
+  int result = -1;
   vector<int> moves;
   // Получаем ходы из траекторий (которые имеет смысл рассматривать), и находим пересечение со входными возможными точками.
-  curTrajectories.buildTrajectories(depth);
+  buildRootTrajectories(&curTrajectories, fields, arenas, depth);
   moves.assign(curTrajectories.getPoints()->begin(), curTrajectories.getPoints()->end());
   // Если нет возможных ходов, входящих в траектории - выходим.
   if (moves.size() == 0)
   {
-    delete[] emptyBoard;
+    deleteThreadsData(fields, arenas, maxThreads);
     return -1;
   }
   // Для почти всех возможных точек, не входящих в траектории оценка будет такая же, как если бы игрок CurPlayer пропустил ход.
   //int enemy_estimate = get_enemy_estimate(cur_field, Trajectories[cur_field.get_player()], Trajectories[next_player(cur_field.get_player())], depth);
-  int maxThreads = omp_get_max_threads();
-  int** emptyBoards = new int*[maxThreads];
-  emptyBoards[0] = emptyBoard;
-  for (auto i = 1; i < maxThreads; i++)
-  {
-    emptyBoards[i] = new int[field->getLength()];
-    fill_n(emptyBoards[i], field->getLength(), 0);
-  }
-  Field** fields = new Field*[maxThreads];
-  fields[0] = field;
-  for (int i = 1; i < maxThreads; i++)
-    fields[i] = new Field(*field);
   int alpha = -curTrajectories.getMaxScore(nextPlayer(field->getPlayer()));
   int beta = curTrajectories.getMaxScore(field->getPlayer());
   #pragma omp parallel
@@ -145,9 +189,9 @@ int minimax(Field* field, int depth)
     {
       if (alpha < beta)
       {
-        int curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -alpha - 1, -alpha, emptyBoards[threadNum]);
+        int curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -alpha - 1, -alpha, arenas[threadNum]);
         if (curEstimate > alpha && curEstimate < beta)
-          curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -beta, -curEstimate, emptyBoards[threadNum]);
+          curEstimate = alphabeta(fields[threadNum], depth - 1, *i, &curTrajectories, -beta, -curEstimate, arenas[threadNum]);
         #pragma omp critical
         {
           if (curEstimate > alpha) // Обновляем нижнюю границу.
@@ -159,12 +203,7 @@ int minimax(Field* field, int depth)
       }
     }
   }
-  result = alpha == getEnemyEstimate(fields, emptyBoards, maxThreads, &curTrajectories, depth - 1) ? -1 : result;
-  for (int i = 0; i < maxThreads; i++)
-    delete[] emptyBoards[i];
-  delete[] emptyBoards;
-  for (int i = 1; i < maxThreads; i++)
-    delete fields[i];
-  delete[] fields;
+  result = alpha == getEnemyEstimate(fields, arenas, maxThreads, &curTrajectories, depth - 1) ? -1 : result;
+  deleteThreadsData(fields, arenas, maxThreads);
   return result;
 }
@@ -5,8 +5,12 @@
 
 using namespace std;
 
-int alphabeta(Field* field, int depth, int pos, Trajectories* last, int alpha, int beta, int* emptyBoard);
+int alphabeta(Field* field, int depth, int pos, Trajectories* last, int alpha, int beta, TrajectoriesArena* arena);
 
-int getEnemyEstimate(Field** fields, int** emptyBoards, int maxThreads, Trajectories* last, int depth);
+int getEnemyEstimate(Field** fields, TrajectoriesArena** arenas, int maxThreads, Trajectories* last, int depth);
+
+void buildRootTrajectories(Trajectories* trajectories, Field** fields, TrajectoriesArena** arenas, int depth);
+
+void deleteThreadsData(Field** fields, TrajectoriesArena** arenas, int maxThreads);
 
 int minimax(Field* field, int depth);
@@ -9,7 +9,7 @@
 
 using namespace std;
 
-int mtdfAlphabeta(Field** fields, vector<int>* moves, int depth, Trajectories* last, int alpha, int beta, int** emptyBoards, int* best)
+int mtdfAlphabeta(Field** fields, vector<int>* moves, int depth, Trajectories* last, int alpha, int beta, TrajectoriesArena** arenas, int* best)
 {
   #pragma omp parallel
   {
@@ -19,7 +19,7 @@ int mtdfAlphabeta(Field** fields, vector<int>* moves, int depth, Trajectories* l
     {
       if (alpha < beta)
       {
-        int curEstimate = alphabeta(fields[threadNum], depth - 1, *i, last, -beta, -alpha, emptyBoards[threadNum]);
+        int curEstimate = alphabeta(fields[threadNum], depth - 1, *i, last, -beta, -alpha, arenas[threadNum]);
         #pragma omp critical
         {
           if (curEstimate > alpha)
@@ -40,53 +40,46 @@ int mtdf(Field* field, int depth)
 {
   if (depth <= 0)
     return -1;
-  int* emptyBoard = new int[field->getLength()];
-  fill_n(emptyBoard, field->getLength(), 0);
+  // Глубина ограничена, чтобы точки траекторий помещались в Trajectory.
+  depth = min(depth, maxTrajectoryDepth);
+  TrajectoriesArena arena(field->getLength(), field->getWidth());
+  int maxThreads = omp_get_max_threads();
+  TrajectoriesArena** arenas = new TrajectoriesArena*[maxThreads];
+  arenas[0] = &arena;
+  for (int i = 1; i < maxThreads; i++)
+    arenas[i] = new TrajectoriesArena(field->getLength(), field->getWidth());
+  Field** fields = new Field*[maxThreads];
+  fields[0] = field;
+  for (int i = 1; i < maxThreads; i++)
+    fields[i] = new Field(*field, FIELD_COPY_SNAPSHOT);
   // Главные траектории - свои и вражеские.
-  Trajectories curTrajectories(field, emptyBoard);
+  Trajectories curTrajectories(field, &arena);
   vector<int> moves;
-  int result;
+  int result = -1;
   // Получаем ходы из траекторий (которые имеет смысл рассматривать), и находим пересечение со входными возможными точками.
-  curTrajectories.buildTrajectories(depth);
+  buildRootTrajectories(&curTrajectories, fields, arenas, depth);
   moves.assign(curTrajectories.getPoints()->begin(), curTrajectories.getPoints()->end());
   // Если нет возможных ходов, входящих в траектории - выходим.
   if (moves.size() == 0)
   {
-    delete[] emptyBoard;
+    deleteThreadsData(fields, arenas, maxThreads);
     return -1;
   }
   int alpha = -curTrajectories.getMaxScore(nextPlayer(field->getPlayer()));
   int beta = curTrajectories.getMaxScore(field->getPlayer());
-  int maxThreads = omp_get_max_threads();
-  int** emptyBoards = new int*[maxThreads];
-  emptyBoards[0] = emptyBoard;
-  for (int i = 1; i < maxThreads; i++)
-  {
-    emptyBoards[i] = new int[field->getLength()];
-    fill_n(emptyBoards[i], field->getLength(), 0);
-  }
-  Field** fields = new Field*[maxThreads];
-  fields[0] = field;
-  for (int i = 1; i < maxThreads; i++)
-    fields[i] = new Field(*field);
   do
   {
     int center = (alpha + beta) / 2;
     if ((alpha + beta) % 2 == -1)
       center--;
-    int curEstimate = mtdfAlphabeta(fields, &moves, depth, &curTrajectories, center, center + 1, emptyBoards, &result);
+    int curEstimate = mtdfAlphabeta(fields, &moves, depth, &curTrajectories, center, center + 1, arenas, &result);
     if (curEstimate > center)
       alpha = curEstimate;
     else
       beta = curEstimate;
   }
   while (alpha != beta);//(beta - alpha > 1);
-  result = alpha == getEnemyEstimate(fields, emptyBoards, maxThreads, &curTrajectories, depth - 1) ? -1 : result;
-  for (int i = 0; i < maxThreads; i++)
-    delete[] emptyBoards[i];
-  delete[] emptyBoards;
-  for (int i = 1; i < maxThreads; i++)
-    delete fields[i];
-  delete[] fields;
+  result = alpha == getEnemyEstimate(fields, arenas, maxThreads, &curTrajectories, depth - 1) ? -1 : result;
+  deleteThreadsData(fields, arenas, maxThreads);
   return result;
 }
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+using namespace std;
+
+// Directions of neighbours in clockwise order starting from north.
+// Bit i of a neighbourhood mask is set if the neighbour in direction i is a not captured point of a player.
+enum NeighbourDirection
+{
+  DIR_N, DIR_NE, DIR_E, DIR_SE, DIR_S, DIR_SW, DIR_W, DIR_NW
+};
+
+// Lookup tables over neighbourhood masks.
+struct NeighbourhoodTables
+{
+  // Number of set neighbours.
+  uint8_t points[256];
+  // Number of groups of set neighbours (number of input points).
+  uint8_t groups[256];
+  // Input points: side neighbour which is clear and the next clockwise diagonal or side neighbour which is set.
+  // Sides are checked in order w, s, e, n, as a diagonal is preferred for a chain point.
+  uint8_t inputChainDirs[256][4];
+  uint8_t inputSurDirs[256][4];
+
+  NeighbourhoodTables()
+  {
+    const int sides[] = { DIR_W, DIR_S, DIR_E, DIR_N };
+    for (int mask = 0; mask < 256; mask++)
+    {
+      points[mask] = 0;
+      for (int i = 0; i < 8; i++)
+        points[mask] += (mask >> i) & 1;
+      groups[mask] = 0;
+      for (int i = 0; i < 4; i++)
+      {
+        int side = sides[i];
+        if ((mask >> side & 1) != 0)
+          continue;
+        int diagonal = (side + 1) % 8;
+        int next = (side + 2) % 8;
+        if ((mask >> diagonal & 1) != 0)
+          inputChainDirs[mask][groups[mask]] = static_cast<uint8_t>(diagonal);
+        else if ((mask >> next & 1) != 0)
+          inputChainDirs[mask][groups[mask]] = static_cast<uint8_t>(next);
+        else
+          continue;
+        inputSurDirs[mask][groups[mask]] = static_cast<uint8_t>(side);
+        groups[mask]++;
+      }
+    }
+  }
+};
+
+static const NeighbourhoodTables neighbourhoodTables;
@@ -0,0 +1,153 @@
+#include "config.h"
+#include "basic_types.h"
+#include "field.h"
+#include "zobrist.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+// Enumerates all move sequences from a position to the given depth with Field::doStep and Field::undoStep.
+// Usage: opai_perft <depth> [--rule 0|1|2] [--size W H] [--pattern clean|crosswire|square] [--random N SEED] [--move X Y]...
+// For every depth from 1 to the given one prints numbers of positions, moves with captures, suicide moves,
+// moves into empty bases, checksum of Zobrist hashes of all positions and elapsed time.
+// Results must not depend on optimizations of Field, so they can be compared between builds for the same rule.
+
+struct PerftResult
+{
+  // Number of positions at the last depth.
+  long nodes;
+  // Number of moves of the last depth which captured something.
+  long captures;
+  // Number of moves of the last depth after which the point was captured.
+  long suicides;
+  // Number of moves of the last depth into empty bases.
+  long emptyBaseEntries;
+  // Sum of Zobrist hashes of positions at the last depth.
+  uint64_t checksum;
+  // Number of undo steps which did not restore hash or score.
+  long undoErrors;
+};
+
+void perft(Field& field, const int depth, PerftResult& result)
+{
+  for (int pos = field.minPos(); pos <= field.maxPos(); pos++)
+  {
+    bool inEmptyBase = field.isInEmptyBase(pos);
+    int64_t hash = field.getHash();
+    int score = field.getScore(playerRed);
+    if (!field.doStep(pos))
+      continue;
+    if (depth == 1)
+    {
+      result.nodes++;
+      if (field.getDeltaScore() > 0)
+        result.captures++;
+      if (field.isCaptured(pos))
+        result.suicides++;
+      if (inEmptyBase)
+        result.emptyBaseEntries++;
+      result.checksum += static_cast<uint64_t>(field.getHash());
+    }
+    else
+    {
+      perft(field, depth - 1, result);
+    }
+    field.undoStep();
+    if (field.getHash() != hash || field.getScore(playerRed) != score)
+      result.undoErrors++;
+  }
+}
+
+void usage()
+{
+  cerr << "Usage: opai_perft <depth> [--rule 0|1|2] [--size W H] [--pattern clean|crosswire|square] [--random N SEED] [--move X Y]..." << endl;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    usage();
+    return 1;
+  }
+  int depth = atoi(argv[1]);
+  int width = 8, height = 8;
+  int rule = SUR_COND;
+  BeginPattern pattern = BEGIN_PATTERN_CROSSWIRE;
+  int randomMoves = 0, randomSeed = 0;
+  vector<pair<int, int>> moves;
+  for (int i = 2; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--rule") == 0 && i + 1 < argc)
+    {
+      rule = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+    {
+      width = atoi(argv[++i]);
+      height = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--pattern") == 0 && i + 1 < argc)
+    {
+      i++;
+      if (strcmp(argv[i], "clean") == 0)
+        pattern = BEGIN_PATTERN_CLEAN;
+      else if (strcmp(argv[i], "square") == 0)
+        pattern = BEGIN_PATTERN_SQUARE;
+      else
+        pattern = BEGIN_PATTERN_CROSSWIRE;
+    }
+    else if (strcmp(argv[i], "--random") == 0 && i + 2 < argc)
+    {
+      randomMoves = atoi(argv[++i]);
+      randomSeed = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--move") == 0 && i + 2 < argc)
+    {
+      int x = atoi(argv[++i]);
+      int y = atoi(argv[++i]);
+      moves.push_back(make_pair(x, y));
+    }
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+  if (depth < 1 || width < 2 || height < 2 || rule < SUR_COND_STANDART || rule > SUR_COND_ALWAYS_ENEMY)
+  {
+    usage();
+    return 1;
+  }
+  mt19937_64 gen(1);
+  Zobrist zobrist(2 * (width + 2) * (height + 2), &gen);
+  Field field(width, height, pattern, &zobrist, static_cast<SurroundCondition>(rule));
+  mt19937 moveGen(randomSeed);
+  for (int i = 0; i < randomMoves; i++)
+    for (int attempt = 0; attempt < width * height; attempt++)
+      if (field.doStep(field.toPos(moveGen() % width, moveGen() % height)))
+        break;
+  for (auto i = moves.begin(); i != moves.end(); i++)
+    if (i->first < 0 || i->first >= width || i->second < 0 || i->second >= height || !field.doStep(field.toPos(i->first, i->second)))
+    {
+      cerr << "Illegal move " << i->first << " " << i->second << endl;
+      return 1;
+    }
+  cout << "sur_cond " << rule << " size " << width << "x" << height << " moves " << field.getMovesCount() << " score " << field.getScore(playerRed) << " hash " << field.getHash() << endl;
+  for (int d = 1; d <= depth; d++)
+  {
+    PerftResult result;
+    memset(&result, 0, sizeof(result));
+    auto begin = chrono::steady_clock::now();
+    perft(field, d, result);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "depth " << d << " nodes " << result.nodes << " captures " << result.captures << " suicides " << result.suicides;
+    cout << " empty_base " << result.emptyBaseEntries << " checksum " << hex << result.checksum << dec << " undo_errors " << result.undoErrors;
+    cout << " time_ms " << seconds * 1000 << " nodes_per_second " << static_cast<long>(result.nodes / max(seconds, 1e-9)) << endl;
+  }
+  return 0;
+}
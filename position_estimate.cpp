@@ -6,32 +6,77 @@ using namespace std;
 
 const int cgSumma[] = {-5, -1, 0, 0, 1, 2, 5, 20, 30};
 
+// Get heuristic estimation of position by numbers of near groups and points of player (g1, p1) and his enemy (g2, p2).
+int positionEstimate(int g1, int g2, int p1, int p2)
+{
+  int c1 = cgSumma[p1];
+  int c2 = cgSumma[p2];
+  return (g1 * 3 + g2 * 2) * (5 - abs(g1 - g2)) - c1 - c2;
+}
+
+// Get bonus of position for being near the last move.
+int lastMoveBonus(Field* field, int pos)
+{
+  if (field->getMovesCount() > 0 && field->isNear(field->getPointsSeq().back(), pos))
+    return 5;
+  return 0;
+}
+
 // Get heuristic estimation of position.
 int positionEstimate(Field* field, int pos, int player)
 {
   int g1 = field->numberNearGroups(pos, player);
   int g2 = field->numberNearGroups(pos, nextPlayer(player));
-  int c1 = cgSumma[field->numberNearPoints(pos, player)];
-  int c2 = cgSumma[field->numberNearPoints(pos, nextPlayer(player))];
-  int result = (g1 * 3 + g2 * 2) * (5 - abs(g1 - g2)) - c1 - c2;
-  if (field->getMovesCount() > 0 && field->isNear(field->getPointsSeq().back(), pos))
-    result += 5;
-  return result;
+  int p1 = field->numberNearPoints(pos, player);
+  int p2 = field->numberNearPoints(pos, nextPlayer(player));
+  return positionEstimate(g1, g2, p1, p2) + lastMoveBonus(field, pos);
 }
 
 int positionEstimate(Field* field)
 {
+  int player = field->getPlayer();
+  int lastPos = field->getMovesCount() > 0 ? field->getPointsSeq().back() : -1;
+  // Only free fields near points and near the last move are estimated separately.
+  // All other free fields have no near points, so their estimate is the same.
+  // Numbers of near groups and points are taken from the neighbourhood masks of Field, so nothing is allocated.
+  const uint64_t* nearRed = field->getNear(playerRed).getData();
+  const uint64_t* nearBlack = field->getNear(playerBlack).getData();
+  const uint64_t* freeWords = field->getFree().getData();
+  auto isNearPoints = [&](int pos) { return ((nearRed[pos >> 6] | nearBlack[pos >> 6]) >> (pos & 63) & 1) != 0; };
   int bestEstimate = numeric_limits<int>::min();
   int result = -1;
-  for (int i = field->minPos(); i <= field->maxPos(); i++)
-    if (field->isPuttingAllowed(i))
+  // The field with the least position wins among fields with the same estimate.
+  auto estimate = [&](int pos)
+  {
+    int curEstimate = positionEstimate(field, pos, player);
+    if (curEstimate > bestEstimate || (curEstimate == bestEstimate && pos < result))
     {
-      int curEstimate = positionEstimate(field, i, field->getPlayer());
-      if (curEstimate > bestEstimate)
+      bestEstimate = curEstimate;
+      result = pos;
+    }
+  };
+  // Outside of active tiles fields have no near points.
+  for (int begin = 0, end = 0; field->nextActiveRun(end, begin, end); )
+    for (int i = begin; i < end; i++)
+      for (uint64_t word = (nearRed[i] | nearBlack[i]) & freeWords[i]; word != 0; word &= word - 1)
+        estimate(i * 64 + __builtin_ctzll(word));
+  // Fields near the last move without near points (if the last point was captured).
+  if (lastPos != -1)
+  {
+    const int neighbours[] = { field->n(lastPos), field->s(lastPos), field->w(lastPos), field->e(lastPos), field->nw(lastPos), field->ne(lastPos), field->sw(lastPos), field->se(lastPos) };
+    for (int i = 0; i < 8; i++)
+      if (field->isPuttingAllowed(neighbours[i]) && !isNearPoints(neighbours[i]))
+        estimate(neighbours[i]);
+  }
+  // The first free field which was not estimated wins if it is better or goes earlier with the same estimate.
+  int otherEstimate = positionEstimate(0, 0, 0, 0);
+  if (otherEstimate >= bestEstimate)
+    for (int pos : field->getFree())
+      if (!isNearPoints(pos) && (lastPos == -1 || !field->isNear(lastPos, pos)))
       {
-        bestEstimate = curEstimate;
-        result = i;
+        if (otherEstimate > bestEstimate || pos < result)
+          result = pos;
+        break;
       }
-    }
   return result;
 }
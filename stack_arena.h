@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// Continuous range of objects in an arena.
+// Непрерывный участок объектов в арене.
+template<typename T>
+struct ArenaSpan
+{
+  T* data;
+  int size;
+
+  ArenaSpan() : data(nullptr), size(0) { }
+  T* begin() const
+  {
+    return data;
+  }
+  T* end() const
+  {
+    return data + size;
+  }
+  bool empty() const
+  {
+    return size == 0;
+  }
+};
+
+// Memory of one search thread for objects of recursion nodes.
+// Nodes take continuous spans and free them in reverse order, as a stack.
+// Blocks are never moved or freed before the arena is deleted, so spans of ancestors stay valid
+// and other threads may read them while the owner of the arena takes new spans.
+// Память одного потока перебора для объектов узлов рекурсии.
+// Узлы занимают непрерывные участки и освобождают их в обратном порядке, как стек.
+// Блоки не перемещаются и не освобождаются до удаления арены, поэтому участки предков остаются верными,
+// и другие потоки могут читать их, пока владелец арены занимает новые участки.
+template<typename T>
+class StackArena
+{
+private:
+  vector<T*> _blocks;
+  vector<int> _capacities;
+  // Текущий блок и количество занятых в нём объектов.
+  int _block;
+  int _used;
+
+public:
+  // Position of the top of the stack.
+  // Положение вершины стека.
+  struct Mark
+  {
+    int block;
+    int used;
+  };
+
+  StackArena(const int blockSize)
+  {
+    _blocks.push_back(new T[blockSize]);
+    _capacities.push_back(blockSize);
+    _block = 0;
+    _used = 0;
+  }
+  StackArena(const StackArena&) = delete;
+  StackArena& operator=(const StackArena&) = delete;
+  ~StackArena()
+  {
+    for (auto i = _blocks.begin(); i != _blocks.end(); i++)
+      delete[] *i;
+  }
+  Mark getMark() const
+  {
+    Mark mark;
+    mark.block = _block;
+    mark.used = _used;
+    return mark;
+  }
+  // Освобождает все участки, занятые после mark.
+  void release(const Mark& mark)
+  {
+    _block = mark.block;
+    _used = mark.used;
+  }
+  // Начинает новый участок на вершине стека.
+  ArenaSpan<T> beginSpan()
+  {
+    ArenaSpan<T> span;
+    span.data = _blocks[_block] + _used;
+    return span;
+  }
+  // Добавляет объект в конец участка span, начатого последним, и возвращает его.
+  // Если блок заполнен, то участок переносится в следующий блок.
+  T& push(ArenaSpan<T>& span)
+  {
+    if (_used == _capacities[_block])
+    {
+      int capacity = max(_capacities[_block], span.size * 2);
+      _block++;
+      if (_block == static_cast<int>(_blocks.size()))
+      {
+        _blocks.push_back(new T[capacity]);
+        _capacities.push_back(capacity);
+      }
+      else if (_capacities[_block] < span.size * 2)
+      {
+        // Блоки после вершины стека никем не используются.
+        delete[] _blocks[_block];
+        _blocks[_block] = new T[capacity];
+        _capacities[_block] = capacity;
+      }
+      copy_n(span.data, span.size, _blocks[_block]);
+      span.data = _blocks[_block];
+      _used = span.size;
+    }
+    _used++;
+    return span.data[span.size++];
+  }
+};
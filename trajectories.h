@@ -2,10 +2,72 @@
 
 #include "field.h"
 #include "trajectory.h"
-#include <list>
+#include "stack_arena.h"
+#include "hash_map.h"
+#include "visit_marks.h"
 #include <vector>
 #include <algorithm>
 
+// Память одного потока перебора для траекторий: арены траекторий и ходов узлов, доска для проецирования траекторий,
+// таблицы для исключения повторов и битборды ходов-кандидатов, которые используются только во время построения одного узла.
+class TrajectoriesArena
+{
+private:
+  StackArena<Trajectory> _trajectories;
+  StackArena<int> _moves;
+  // Доска, на которую проецируются траектории. Между вызовами calculateMoves заполнена нулями.
+  int* _board;
+  // Хеши траекторий игрока, построенных в узле, или объединений их пар.
+  HashMap _hashes;
+  // Ходы, уже добавленные в список.
+  VisitMarks _marks;
+  // Ходы-кандидаты каждого уровня рекурсии построения траекторий (по оставшейся глубине).
+  Bitboard* _candidates[maxTrajectoryLength];
+
+public:
+  TrajectoriesArena(const int length, const int width) : _trajectories(1024), _moves(1024), _hashes(256), _marks(length)
+  {
+    _board = new int[length];
+    fill_n(_board, length, 0);
+    for (int i = 0; i < maxTrajectoryLength; i++)
+      _candidates[i] = new Bitboard(length, width + 3);
+  }
+  TrajectoriesArena(const TrajectoriesArena&) = delete;
+  TrajectoriesArena& operator=(const TrajectoriesArena&) = delete;
+  ~TrajectoriesArena()
+  {
+    delete[] _board;
+    for (int i = 0; i < maxTrajectoryLength; i++)
+      delete _candidates[i];
+  }
+  StackArena<Trajectory>& getTrajectories()
+  {
+    return _trajectories;
+  }
+  StackArena<int>& getMoves()
+  {
+    return _moves;
+  }
+  int* getBoard()
+  {
+    return _board;
+  }
+  HashMap& getHashes()
+  {
+    return _hashes;
+  }
+  VisitMarks& getMarks()
+  {
+    return _marks;
+  }
+  Bitboard& getCandidates(const int depth)
+  {
+    return *_candidates[depth];
+  }
+};
+
+// Траектории узла перебора. Хранятся в арене потока и освобождаются при удалении узла,
+// поэтому узлы одного потока должны удаляться в обратном порядке создания.
 class Trajectories
 {
 private:
@@ -14,11 +76,15 @@ private:
 
   int _depth[2];
   Field* _field;
-  list<Trajectory> _trajectories[2];
+  TrajectoriesArena* _arena;
+  // Вершины арен при создании узла.
+  StackArena<Trajectory>::Mark _trajectoriesMark;
+  StackArena<int>::Mark _movesMark;
+  ArenaSpan<Trajectory> _trajectories[2];
   int* _trajectoriesBoard;
   Zobrist* _zobrist;
-  list<int> _moves[2];
-  list<int> _allMoves;
+  ArenaSpan<int> _moves[2];
+  ArenaSpan<int> _allMoves;
 
   /** Private methods **/
 
@@ -35,56 +101,62 @@ private:
     // Высчитываем хеш траектории и сравниваем с уже существующими для исключения повторов.
     for (auto i = begin; i < end; i++)
       hash ^= _zobrist->getHash(*i);
-    for (auto i = _trajectories[player].begin(); i != _trajectories[player].end(); i++)
-      if (hash == i->getHash())
-        return;
-    _trajectories[player].emplace_back(begin, end, _zobrist, hash);
+    if (!_arena->getHashes().insert(hash, 0))
+      return;
+    _arena->getTrajectories().push(_trajectories[player]) = Trajectory(begin, end, _zobrist, hash);
   }
   void addTrajectory(Trajectory* trajectory, int player)
   {
-    _trajectories[player].emplace_back(*trajectory);
+    _arena->getTrajectories().push(_trajectories[player]) = *trajectory;
   }
   void addTrajectory(Trajectory* trajectory, int pos, int player)
   {
     if (trajectory->size() == 1 && trajectory->front() == pos)
       return;
-    _trajectories[player].emplace_back(_zobrist);
+    Trajectory& result = _arena->getTrajectories().push(_trajectories[player]);
+    result = Trajectory(_zobrist);
     for (auto i = trajectory->begin(); i != trajectory->end(); i++)
       if (*i != pos)
-        _trajectories[player].back().pushBack(*i);
+        result.pushBack(*i);
   }
-  void buildTrajectoriesRecursive(int depth, int player)
+  // Строит траектории игрока player, продолжающиеся ходом pos.
+  void buildTrajectoriesFrom(int pos, int depth, int player)
   {
-    for (auto pos = _field->minPos(); pos <= _field->maxPos(); pos++)
+    if (_field->isInEmptyBase(pos)) // Если поставили в пустую базу (свою или нет), то дальше строить траекторию нет нужды.
+    {
+      _field->doUnsafeStep(pos, player);
+      if (_field->getDeltaScore(player) > 0)
+        addTrajectory(_field->getPointsSeq().end() - (_depth[player] - depth), _field->getPointsSeq().end(), player);
+      _field->undoStep();
+    }
+    else if (depth > 0 || _field->maySurround(pos, player))
     {
-      if (_field->isPuttingAllowed(pos) && _field->isNearPoints(pos, player))
+      // Последний ход траектории делается, только если он может что-то окружить, иначе траектория не добавляется.
+      _field->doUnsafeStep(pos, player);
+      // Если при окружении всегда поставленная точка окружила пустую территорию, то траектория дальше не строится.
+      // Прежняя ветка под #if SUR_COND == 1 вызывала несуществующий isBaseBound и не компилировалась;
+      // точка, окружившая что-либо, определяется по isBound.
+      if (_field->getSurroundCondition() == SUR_COND_ALWAYS && _field->isBound(pos) && _field->getDeltaScore(player) == 0)
       {
-        if (_field->isInEmptyBase(pos)) // Если поставили в пустую базу (свою или нет), то дальше строить траекторию нет нужды.
-        {
-          _field->doUnsafeStep(pos, player);
-          if (_field->getDeltaScore(player) > 0)
-            addTrajectory(_field->getPointsSeq().end() - (_depth[player] - depth), _field->getPointsSeq().end(), player);
-          _field->undoStep();
-        }
-        else
-        {
-          _field->doUnsafeStep(pos, player);
-#if SUR_COND == 1
-          if (_field->isBaseBound(pos) && _field->getDeltaScore(player) == 0)
-          {
-            _field->undoStep();
-            continue;
-          }
-#endif
-          if (_field->getDeltaScore(player) > 0)
-            addTrajectory(_field->getPointsSeq().end() - (_depth[player] - depth), _field->getPointsSeq().end(), player);
-          else if (depth > 0)
-            buildTrajectoriesRecursive(depth - 1, player);
-          _field->undoStep();
-        }
+        _field->undoStep();
+        return;
       }
+      if (_field->getDeltaScore(player) > 0)
+        addTrajectory(_field->getPointsSeq().end() - (_depth[player] - depth), _field->getPointsSeq().end(), player);
+      else if (depth > 0)
+        buildTrajectoriesRecursive(depth - 1, player);
+      _field->undoStep();
     }
   }
+  void buildTrajectoriesRecursive(int depth, int player)
+  {
+    Bitboard& candidates = _arena->getCandidates(depth);
+    _field->getCandidates(player, candidates);
+    // Откат ходов возвращает активные плитки поля, поэтому серии не меняются во время обхода.
+    for (int begin = 0, end = 0; _field->nextActiveRun(end, begin, end); )
+      for (int pos : candidates.range(begin, end))
+        buildTrajectoriesFrom(pos, depth, player);
+  }
   void project(Trajectory* trajectory)
   {
     for (auto j = trajectory->begin(); j != trajectory->end(); j++)
@@ -165,29 +237,51 @@ private:
   {
     while (excludeUnnecessaryTrajectories(playerRed) || excludeUnnecessaryTrajectories(playerBlack));
   }
-  // Исключает составные траектории.
+  // Исключает составные траектории - совпадающие с объединением двух более коротких траекторий.
+  // Для хеша объединения каждой пары запоминается наименьшая длина большей из траекторий пары,
+  // и траектория исключается, если она длиннее запомненной для её хеша.
   void excludeCompositeTrajectories(int player)
   {
-    list<Trajectory>::iterator i, j, k;
-    for (k = _trajectories[player].begin(); k != _trajectories[player].end(); ++k)
-      for (i = _trajectories[player].begin(); i != --_trajectories[player].end(); ++i)
-        if (k->size() > i->size())
-          for (j = i, ++j; j != _trajectories[player].end(); ++j)
-            if (k->size() > j->size() && k->getHash() == getIntersectHash(&(*i), &(*j)))
-              k->exclude();
+    Trajectory* begin = _trajectories[player].begin();
+    Trajectory* end = _trajectories[player].end();
+    HashMap& unions = _arena->getHashes();
+    unions.clear();
+    for (Trajectory* i = begin; i != end; ++i)
+      for (Trajectory* j = i + 1; j != end; ++j)
+      {
+        int64_t hash = getIntersectHash(i, j);
+        int size = max(i->size(), j->size());
+        int* minSize = unions.find(hash);
+        if (minSize == nullptr)
+          unions.insert(hash, size);
+        else if (*minSize > size)
+          *minSize = size;
+      }
+    for (Trajectory* k = begin; k != end; ++k)
+    {
+      int* minSize = unions.find(k->getHash());
+      if (minSize != nullptr && *minSize < k->size())
+        k->exclude();
+    }
   }
   void excludeCompositeTrajectories()
   {
     excludeCompositeTrajectories(playerRed);
     excludeCompositeTrajectories(playerBlack);
   }
-  void getPoints(list<int>* moves, int player)
+  void getPoints(ArenaSpan<int>* moves, int player)
   {
+    VisitMarks& marks = _arena->getMarks();
+    marks.clear();
+    *moves = _arena->getMoves().beginSpan();
     for (auto i = _trajectories[player].begin(); i != _trajectories[player].end(); i++)
       if (!i->excluded())
         for (auto j = i->begin(); j != i->end(); j++)
-          if (find(moves->begin(), moves->end(), *j) == moves->end())
-            moves->push_back(*j);
+          if (!marks.test(*j))
+          {
+            marks.set(*j);
+            _arena->getMoves().push(*moves) = *j;
+          }
   }
   int calculateMaxScore(int player, int depth)
   {
@@ -197,6 +291,14 @@ private:
       for (auto i = _moves[player].begin(); i != _moves[player].end(); i++)
         if (_field->isPuttingAllowed(*i))
         {
+          // На последнем уровне достаточно знать, как ход изменит счет.
+          if (depth == 1)
+          {
+            int delta = _field->getCaptureDelta(*i, player);
+            if (delta >= 0 && result < _field->getScore(player) + delta)
+              result = _field->getScore(player) + delta;
+            continue;
+          }
           _field->doUnsafeStep(*i, player);
           if (_field->getDeltaScore(player) >= 0)
           {
@@ -214,7 +316,18 @@ public:
 
   /** Public methods **/
 
-  Trajectories(Field* field, int* emptyBoard) : _field(field), _trajectoriesBoard(emptyBoard), _zobrist(&field->getZobrist()) { }
+  Trajectories(Field* field, TrajectoriesArena* arena) : _field(field), _arena(arena), _trajectoriesBoard(arena->getBoard()), _zobrist(&field->getZobrist())
+  {
+    _trajectoriesMark = arena->getTrajectories().getMark();
+    _movesMark = arena->getMoves().getMark();
+  }
+  Trajectories(const Trajectories&) = delete;
+  Trajectories& operator=(const Trajectories&) = delete;
+  ~Trajectories()
+  {
+    _arena->getTrajectories().release(_trajectoriesMark);
+    _arena->getMoves().release(_movesMark);
+  }
   int getCurPlayer()
   {
     return _field->getPlayer();
@@ -225,7 +338,7 @@ public:
   }
   void clear(int player)
   {
-    _trajectories[player].clear();
+    _trajectories[player] = ArenaSpan<Trajectory>();
   }
   void clear()
   {
@@ -234,9 +347,55 @@ public:
   }
   void buildPlayerTrajectories(int player)
   {
+    beginTrajectories(player);
     if (_depth[player] > 0)
       buildTrajectoriesRecursive(_depth[player] - 1, player);
   }
+  // Начинает в арене траектории игрока player. Траектории игроков добавляются по очереди.
+  void beginTrajectories(int player)
+  {
+    _trajectories[player] = _arena->getTrajectories().beginSpan();
+    _arena->getHashes().clear();
+  }
+  // Задаёт глубину траекторий игроков для перебора на глубину depth.
+  // Большая глубина ограничивается maxTrajectoryDepth, чтобы точки траекторий помещались в Trajectory.
+  void setDepth(int depth)
+  {
+    depth = min(depth, maxTrajectoryDepth);
+    _depth[getCurPlayer()] = (depth + 1) / 2;
+    _depth[getEnemyPlayer()] = depth / 2;
+  }
+  // Записывает в moves первые ходы траекторий игрока player. Ветки траекторий по первым ходам независимы,
+  // поэтому их можно строить параллельно на копиях поля (buildPlayerTrajectories(player, pos)) и объединять
+  // в порядке moves (mergeTrajectories), получая те же траектории, что и buildPlayerTrajectories(player).
+  void getFirstMoves(int player, vector<int>* moves)
+  {
+    moves->clear();
+    if (_depth[player] == 0)
+      return;
+    Bitboard& candidates = _arena->getCandidates(_depth[player] - 1);
+    _field->getCandidates(player, candidates);
+    for (int begin = 0, end = 0; _field->nextActiveRun(end, begin, end); )
+      for (int pos : candidates.range(begin, end))
+        moves->push_back(pos);
+  }
+  // Строит траектории игрока player, начинающиеся с хода pos.
+  void buildPlayerTrajectories(int player, int pos)
+  {
+    beginTrajectories(player);
+    buildTrajectoriesFrom(pos, _depth[player] - 1, player);
+  }
+  const ArenaSpan<Trajectory>* getTrajectories(int player) const
+  {
+    return &_trajectories[player];
+  }
+  // Добавляет к траекториям игрока player, начатым beginTrajectories, траектории, которых среди них ещё нет.
+  void mergeTrajectories(const Trajectory* begin, const Trajectory* end, int player)
+  {
+    for (auto i = begin; i != end; i++)
+      if (_arena->getHashes().insert(i->getHash(), 0))
+        _arena->getTrajectories().push(_trajectories[player]) = *i;
+  }
   void calculateMoves()
   {
     excludeCompositeTrajectories();
@@ -247,12 +406,19 @@ public:
     // Получаем список точек, входящих в оставшиеся неисключенные траектории.
     getPoints(&_moves[playerRed], playerRed);
     getPoints(&_moves[playerBlack], playerBlack);
-    _allMoves.assign(_moves[playerRed].begin(), _moves[playerRed].end());
+    VisitMarks& marks = _arena->getMarks();
+    marks.clear();
+    _allMoves = _arena->getMoves().beginSpan();
+    for (auto i = _moves[playerRed].begin(); i != _moves[playerRed].end(); i++)
+    {
+      marks.set(*i);
+      _arena->getMoves().push(_allMoves) = *i;
+    }
     for (auto i = _moves[playerBlack].begin(); i != _moves[playerBlack].end(); i++)
-      if (find(_allMoves.begin(), _allMoves.end(), *i) == _allMoves.end())
-        _allMoves.push_back(*i);
+      if (!marks.test(*i))
+        _arena->getMoves().push(_allMoves) = *i;
 #if ALPHABETA_SORT
-    _allMoves.sort([&](pos x, pos y){ return _trajectories_board[x] < _trajectories_board[y]; });
+    stable_sort(_allMoves.begin(), _allMoves.end(), [&](int x, int y){ return _trajectoriesBoard[x] < _trajectoriesBoard[y]; });
 #endif
     // Очищаем доску от проекций.
     unproject();
@@ -261,8 +427,7 @@ public:
   }
   void buildTrajectories(int depth)
   {
-    _depth[getCurPlayer()] = (depth + 1) / 2;
-    _depth[getEnemyPlayer()] = depth / 2;
+    setDepth(depth);
     buildPlayerTrajectories(getCurPlayer());
     buildPlayerTrajectories(getEnemyPlayer());
     calculateMoves();
@@ -271,14 +436,16 @@ public:
   {
     _depth[getCurPlayer()] = last->_depth[getCurPlayer()];
     _depth[getEnemyPlayer()] = last->_depth[getEnemyPlayer()] - 1;
+    beginTrajectories(getCurPlayer());
     if (_depth[getCurPlayer()] > 0)
       buildTrajectoriesRecursive(_depth[getCurPlayer()] - 1, getCurPlayer());
+    beginTrajectories(getEnemyPlayer());
     if (_depth[getEnemyPlayer()] > 0)
       for (auto i = last->_trajectories[getEnemyPlayer()].begin(); i != last->_trajectories[getEnemyPlayer()].end(); i++)
         if ((i->size() <= _depth[getEnemyPlayer()] ||
            (i->size() == _depth[getEnemyPlayer()] + 1 &&
-           find(i->begin(), i->end(), pos) != i->end())) && i->isValid(_field, pos))
-          addTrajectory(&(*i), pos, getEnemyPlayer());
+           i->contains(pos))) && i->isValid(_field, pos))
+          addTrajectory(i, pos, getEnemyPlayer());
     calculateMoves();
   }
   // Строит траектории с учетом предыдущих траекторий и того, что последний ход был сделан не на траектории (или не сделан вовсе).
@@ -286,17 +453,19 @@ public:
   {
     _depth[getCurPlayer()] = last->_depth[getCurPlayer()];
     _depth[getEnemyPlayer()] = last->_depth[getEnemyPlayer()] - 1;
+    beginTrajectories(getCurPlayer());
     if (_depth[getCurPlayer()] > 0)
       for (auto i = last->_trajectories[getCurPlayer()].begin(); i != last->_trajectories[getCurPlayer()].end(); i++)
-        addTrajectory(&(*i), getCurPlayer());
+        addTrajectory(i, getCurPlayer());
+    beginTrajectories(getEnemyPlayer());
     if (_depth[getEnemyPlayer()] > 0)
       for (auto i = last->_trajectories[getEnemyPlayer()].begin(); i != last->_trajectories[getEnemyPlayer()].end(); i++)
         if (i->size() <= _depth[getEnemyPlayer()])
-          addTrajectory(&(*i), getEnemyPlayer());
+          addTrajectory(i, getEnemyPlayer());
     calculateMoves();
   }
   // Получить список ходов.
-  const list<int>* getPoints() const
+  const ArenaSpan<int>* getPoints() const
   {
     return &_allMoves;
   }
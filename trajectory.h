@@ -1,19 +1,34 @@
 #pragma once
 
+#include "config.h"
 #include "zobrist.h"
-#include <list>
+#include <algorithm>
 
+// Наибольшая длина траектории: траектории игрока строятся на половину глубины перебора, округлённую вверх.
+const int maxTrajectoryDepth = MAX_MINIMAX_DEPTH > MAX_MTDF_DEPTH ? MAX_MINIMAX_DEPTH : MAX_MTDF_DEPTH;
+const int maxTrajectoryLength = (maxTrajectoryDepth + 1) / 2;
+
+// Траектория хранит точки в самом объекте, поэтому её можно копировать без выделения памяти.
 class Trajectory
 {
 private:
-  list<int> _points;
+  int _points[maxTrajectoryLength];
+  int _size;
   Zobrist* _zobrist;
   int64_t _hash;
   bool _excluded;
 
 public:
+  Trajectory()
+  {
+    _size = 0;
+    _hash = 0;
+    _excluded = false;
+    _zobrist = nullptr;
+  }
   Trajectory(Zobrist* zobrist)
   {
+    _size = 0;
     _hash = 0;
     _excluded = false;
     _zobrist = zobrist;
@@ -21,6 +36,7 @@ public:
   template<typename _InIt>
   Trajectory(_InIt first, _InIt last, Zobrist* zobrist)
   {
+    _size = 0;
     _hash = 0;
     _excluded = false;
     _zobrist = zobrist;
@@ -33,91 +49,69 @@ public:
     _zobrist = zobrist;
     assign(first, last, hash);
   }
-  Trajectory(const Trajectory &other) : _points(other._points), _hash(other._hash), _excluded(other._excluded), _zobrist(other._zobrist) { }
   int size() const
   {
-    return _points.size();
+    return _size;
   }
   bool empty() const
   {
-    return _points.empty();
+    return _size == 0;
   }
   void pushBack(int pos)
   {
-    _points.push_back(pos);
+    _points[_size++] = pos;
     _hash ^= _zobrist->getHash(pos);
   }
   void clear()
   {
-    _points.clear();
+    _size = 0;
     _hash = 0;
     _excluded = false;
   }
-  const Trajectory& operator =(const Trajectory &other)
-  {
-    _points = other._points;
-    _hash = other._hash;
-    _excluded = other._excluded;
-    _zobrist = other._zobrist;
-    return *this;
-  }
   void swap(Trajectory &other)
   {
     Trajectory tmp(*this);
     *this = other;
     other = tmp;
   }
-  list<int>::iterator begin()
-  {
-    return _points.begin();
-  }
-  list<int>::const_iterator begin() const
+  int* begin()
   {
-    return _points.begin();
+    return _points;
   }
-  list<int>::iterator end()
+  const int* begin() const
   {
-    return _points.end();
+    return _points;
   }
-  list<int>::const_iterator end() const
+  int* end()
   {
-    return _points.end();
+    return _points + _size;
   }
-  list<int>::reverse_iterator rbegin()
+  const int* end() const
   {
-    return _points.rbegin();
-  }
-  list<int>::reverse_iterator rend()
-  {
-    return _points.rend();
-  }
-  list<int>::const_reverse_iterator rbegin() const
-  {
-    return _points.rbegin();
-  }
-  list<int>::const_reverse_iterator rend() const
-  {
-    return _points.rend();
+    return _points + _size;
   }
   template<typename _InIt>
   void assign(_InIt first, _InIt last)
   {
+    clear();
     for (auto i = first; i != last; i++)
-      push_back(*i, _zobrist->getHash(*i));
+      pushBack(*i);
   }
   template<typename _InIt>
   void assign(_InIt first, _InIt last, int64_t hash)
   {
-    _points.assign(first, last);
+    _size = 0;
+    for (auto i = first; i != last; i++)
+      _points[_size++] = *i;
     _hash = hash;
   }
   int front() const
   {
-    return _points.front();
+    return _points[0];
   }
   int back() const
   {
-    return _points.back();
+    return _points[_size - 1];
   }
   int64_t getHash() const
   {
@@ -135,10 +129,15 @@ public:
   {
     return _excluded;
   }
+  // Проверяет, содержит ли траектория точку pos.
+  bool contains(int pos) const
+  {
+    return find(begin(), end(), pos) != end();
+  }
   // Проверяет, во все ли точки траектории можно сделать ход.
   bool isValid(Field* field) const
   {
-    for (auto i = _points.begin(); i != _points.end(); i++)
+    for (auto i = begin(); i != end(); i++)
       if (!field->isPuttingAllowed(*i))
         return false;
     return true;
@@ -146,7 +145,7 @@ public:
   // Проверяет, во все ли точки траектории можно сделать ход, кроме, возможно, точки cur_pos.
   bool isValid(Field* field, int pos) const
   {
-    for (auto i = _points.begin(); i != _points.end(); i++)
+    for (auto i = begin(); i != end(); i++)
       if (*i != pos && !field->isPuttingAllowed(*i))
         return false;
     return true;
@@ -17,15 +17,16 @@ using namespace boost;
 // field - field to play.
 // gen - random number generator.
 // possibleMoves - allowed positions of moves.
+// checkpoint - buffer to save the position before the game.
 // Returns number of winner, or -1 if draw.
-int playRandomGame(Field* field, mt19937* gen, vector<int>* possibleMoves, int* moves, int komi)
+int playRandomGame(Field* field, mt19937* gen, vector<int>* possibleMoves, int* moves, FieldCheckpoint* checkpoint, int komi)
 {
   int redKomi;
   if (field->getPlayer() == playerRed)
     redKomi = komi;
   else
     redKomi = -komi;
-  int putted = 0, result;
+  int result;
   moves[0] = (*possibleMoves)[0];
   int size = static_cast<int>(possibleMoves->size());
   for (int i = 1; i < size; i++)
@@ -35,14 +36,12 @@ int playRandomGame(Field* field, mt19937* gen, vector<int>* possibleMoves, int*
     moves[i] = moves[j];
     moves[j] = (*possibleMoves)[i];
   }
+  field->makeCheckpoint(*checkpoint);
   for (int i = 0; i < size; i++)
   {
     int pos = moves[i];
     if (field->isPuttingAllowed(pos) && !field->isInEmptyBase(pos))
-    {
       field->doUnsafeStep(pos);
-      putted++;
-    }
   }
   if (field->getScore(playerRed) > redKomi)
     result = playerRed;
@@ -50,8 +49,7 @@ int playRandomGame(Field* field, mt19937* gen, vector<int>* possibleMoves, int*
     result = playerBlack;
   else
     result = -1;
-  for (int i = 0; i < putted; i++)
-    field->undoStep();
+  field->restoreCheckpoint(*checkpoint);
   return result;
 }
 
@@ -151,15 +149,16 @@ UctNode* uctSelect(mt19937* gen, UctNode* node)
 // field - field to play simulation.
 // gen - random number generator.
 // possibleMoves - allowed positions of moves.
+// checkpoint - buffer to save positions before random games.
 // node - UCT node to play simulation.
 // depth - current depth of UCT simulation.
 // Returns number of winner, or -1 if draw.
-int playSimulation(Field* field, mt19937* gen, vector<int>* possibleMoves, int* moves, UctNode* node, int depth, int komi)
+int playSimulation(Field* field, mt19937* gen, vector<int>* possibleMoves, int* moves, FieldCheckpoint* checkpoint, UctNode* node, int depth, int komi)
 {
   int randomResult;
   if (node->visits.load(std::memory_order_relaxed) < UCT_WHEN_CREATE_CHILDREN || depth == UCT_DEPTH)
   {
-    randomResult = playRandomGame(field, gen, possibleMoves, moves, komi);
+    randomResult = playRandomGame(field, gen, possibleMoves, moves, checkpoint, komi);
   }
   else
   {
@@ -182,14 +181,14 @@ int playSimulation(Field* field, mt19937* gen, vector<int>* possibleMoves, int*
     }
     else
     {
-      field->doUnsafeStep(next->move);
-      if (field->getDeltaScore() < 0)
+      // Точка может быть окружена, только если поставлена в пустую базу противника.
+      if (field->isInEmptyBase(next->move) && field->getCaptureDelta(next->move, field->getPlayer()) < 0)
       {
-        field->undoStep();
         next->visits.store(numeric_limits<int>::max(), std::memory_order_relaxed);
-        return playSimulation(field, gen, possibleMoves, moves, node, depth, komi);
+        return playSimulation(field, gen, possibleMoves, moves, checkpoint, node, depth, komi);
       }
-      randomResult = playSimulation(field, gen, possibleMoves, moves, next, depth + 1, -komi);
+      field->doUnsafeStep(next->move);
+      randomResult = playSimulation(field, gen, possibleMoves, moves, checkpoint, next, depth + 1, -komi);
       field->undoStep();
     }
   }
@@ -201,9 +200,9 @@ int playSimulation(Field* field, mt19937* gen, vector<int>* possibleMoves, int*
   return randomResult;
 }
 
-void playSimulation(Field* field, mt19937* gen, UctRoot* root, int* moves, int& ratched)
+void playSimulation(Field* field, mt19937* gen, UctRoot* root, int* moves, FieldCheckpoint* checkpoint, int& ratched)
 {
-  playSimulation(field, gen, &root->moves, moves, root->node, 0, root->komi);
+  playSimulation(field, gen, &root->moves, moves, checkpoint, root->node, 0, root->komi);
 #if DYNAMIC_KOMI == 1
   int visits = root->node->visits.load(std::memory_order_relaxed);
   double winRate = 1 - (root->node->wins.load(std::memory_order_relaxed) + root->node->draws.load(std::memory_order_relaxed) * UCT_DRAW_WEIGHT) / visits;
@@ -253,8 +252,9 @@ int uct(UctRoot* root, Field* field, mt19937_64* gen, int maxSimulations, bool*
   int ratched = numeric_limits<int>::max();
   #pragma omp parallel
   {
-    Field* localField = new Field(*field);
+    Field* localField = new Field(*field, FIELD_COPY_SNAPSHOT);
     int* moves = new int[root->moves.size()];
+    FieldCheckpoint checkpoint;
     uniform_int_distribution<int> localDist(numeric_limits<int>::min(), numeric_limits<int>::max());
     mt19937* localGen;
     #pragma omp critical
@@ -262,13 +262,13 @@ int uct(UctRoot* root, Field* field, mt19937_64* gen, int maxSimulations, bool*
     if (maxSimulations == numeric_limits<int>::max())
     {
       while (!*needBreak)
-        playSimulation(localField, localGen, root, moves, ratched);
+        playSimulation(localField, localGen, root, moves, &checkpoint, ratched);
     }
     else
     {
       #pragma omp for
       for (int i = 0; i < maxSimulations; i++)
-        playSimulation(localField, localGen, root, moves, ratched);
+        playSimulation(localField, localGen, root, moves, &checkpoint, ratched);
     }
     delete localGen;
     delete[] moves;
@@ -314,7 +314,7 @@ int uctWithTime(UctRoot* root, Field* field, mt19937_64* gen, int time)
   bool needBreak = false;
   asio::io_service io;
   asio::deadline_timer timer(io, posix_time::milliseconds(time));
-  thread thread([&]() { timer.wait(); needBreak = true; });
+  boost::thread thread([&]() { timer.wait(); needBreak = true; });
   return uct(root, field, gen, numeric_limits<int>::max(), &needBreak);
 }
 
@@ -332,13 +332,16 @@ void clearUct(UctRoot* root, int length)
   root->komiIter = 0;
 }
 
-void initUct(Field* field, UctRoot* root)
+void initUct(const Field* field, UctRoot* root)
 {
   root->node = new UctNode;
   root->player = field->getPlayer();
   root->komi = field->getScore(root->player);
   const vector<int>& pointsSeq = field->getPointsSeq();
   root->pointsSeq.assign(pointsSeq.begin(), pointsSeq.end());
+  // Поле только читается, поэтому обходы используют собственные пометки и очередь.
+  VisitMarks marks(field->getLength());
+  vector<int> queue(field->getLength());
   for (auto it = pointsSeq.begin(); it != pointsSeq.end(); it++)
   {
     int startPos = *it;
@@ -357,11 +360,11 @@ void initUct(Field* field, UctRoot* root)
       {
         return false;
       }
-    });
+    }, marks, queue.data());
   }
 }
 
-UctRoot* initUct(Field* field)
+UctRoot* initUct(const Field* field)
 {
   UctRoot* root = new UctRoot(field->getLength());
   initUct(field, root);
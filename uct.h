@@ -54,7 +54,7 @@ struct UctRoot
 
 void updateUct(Field* field, UctRoot* root);
 
-UctRoot* initUct(Field* field);
+UctRoot* initUct(const Field* field);
 
 void finalUct(UctRoot* root);
 
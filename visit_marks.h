@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+// Marks of visited positions stamped with an epoch.
+// Position is marked if its stamp equals the current epoch, so all marks are cleared in O(1) by incrementing the epoch.
+class VisitMarks
+{
+private:
+  // Number of positions.
+  int _size;
+  // Stamps of positions, 0 is never the current epoch.
+  // Stamps are narrower than the epoch, so that writing them does not force compiler to reload the epoch.
+  uint16_t* _stamps;
+  // Current epoch, never exceeds maximum stamp.
+  uint32_t _epoch;
+
+public:
+  VisitMarks(const int size)
+  {
+    _size = size;
+    _stamps = new uint16_t[size];
+    fill_n(_stamps, size, 0);
+    _epoch = 1;
+  }
+  // Marks are temporary, so a copy starts without them.
+  VisitMarks(const VisitMarks &other) : VisitMarks(other._size) { }
+  ~VisitMarks()
+  {
+    delete[] _stamps;
+  }
+  // Clears all marks.
+  void clear()
+  {
+    _epoch++;
+    if (_epoch > numeric_limits<uint16_t>::max())
+    {
+      fill_n(_stamps, _size, 0);
+      _epoch = 1;
+    }
+  }
+  bool test(const int pos) const
+  {
+    return _stamps[pos] == _epoch;
+  }
+  void set(const int pos)
+  {
+    _stamps[pos] = static_cast<uint16_t>(_epoch);
+  }
+  void reset(const int pos)
+  {
+    _stamps[pos] = 0;
+  }
+};
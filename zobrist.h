@@ -1,5 +1,6 @@
 #pragma once
 
+#include "config.h"
 #include <random>
 #include <limits>
 #include <algorithm>
@@ -14,6 +15,10 @@ private:
   int _size;
   // Hash table
   int64_t* _hashes;
+#if ZOBRIST_LOCK
+  // Independent table of locks, which extend hashes to 128 bits.
+  int64_t* _locks;
+#endif
 public:
   // Constructor.
   Zobrist(const int size, mt19937_64* gen)
@@ -23,6 +28,11 @@ public:
     _hashes = new int64_t[size];
     for (int i = 0; i < size; i++)
       _hashes[i] = dist(*gen);
+#if ZOBRIST_LOCK
+    _locks = new int64_t[size];
+    for (int i = 0; i < size; i++)
+      _locks[i] = dist(*gen);
+#endif
   }
   // Copy constructor.
   Zobrist(const Zobrist &other)
@@ -30,15 +40,29 @@ public:
     _size = other._size;
     _hashes = new int64_t[other._size];
     copy_n(other._hashes, other._size, _hashes);
+#if ZOBRIST_LOCK
+    _locks = new int64_t[other._size];
+    copy_n(other._locks, other._size, _locks);
+#endif
   }
   // Destructor.
   ~Zobrist()
   {
-    delete _hashes;
+    delete[] _hashes;
+#if ZOBRIST_LOCK
+    delete[] _locks;
+#endif
   }
   // Get hash by number.
   int64_t getHash(const int pos) const
   {
     return _hashes[pos];
   }
+#if ZOBRIST_LOCK
+  // Get lock by number.
+  int64_t getLock(const int pos) const
+  {
+    return _locks[pos];
+  }
+#endif
 };